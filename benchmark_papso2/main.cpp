@@ -1,13 +1,16 @@
 #pragma comment ( lib, "Shlwapi.lib" )
 #include "../../google_benchmark/include/benchmark/benchmark.h"
 #include "../papso2/executor.h"
+#include "../papso2/chase_lev_deque.h"
 #include "../papso2/papso2_test.h"
+#include "../papso2/sequential_pso.h"
+#include "../papso2/papso_mp.h"
 
 
 template <size_t Scale> requires (Scale > 0)
 struct scaled_rosenbrock {
 	static double function(iter beg, iter end) {
-		static constexpr auto rosenbrock = test_functions::functions[2];
+		static constexpr auto rosenbrock = test_functions::simd_functions[2];
 		volatile double result = 0;
 		for (int i = 0; i < Scale; ++i) {
 			//benchmark::DoNotOptimize(  );
@@ -52,6 +55,124 @@ static void benchmark_executor_create(benchmark::State& state) {
 //->Unit(benchmark::kMicrosecond)
 //->Arg(1)->Arg(2)->Arg(3)->Arg(4)->Arg(5)->Arg(6)->Arg(7)->Arg(8);
 
+// Stress test of the work-stealing deque: the owner pushes in bursts and pops,
+// thieves steal concurrently; every item must be taken exactly once.
+// Args: [thief_count]
+static void benchmark_chase_lev_deque_stress(benchmark::State& state) {
+	constexpr std::size_t item_count = 1 << 20;
+	const auto thief_count = static_cast<std::size_t>(state.range(0));
+
+	for (auto _ : state) {
+		hungbiu::chase_lev_deque<std::size_t> deque;
+		std::vector<std::atomic<unsigned>> taken(item_count);
+		std::atomic<bool> finished{ false };
+		auto take = [&](std::size_t item) {
+			taken[item].fetch_add(1, std::memory_order_relaxed);
+		};
+
+		std::vector<std::jthread> thieves;
+		for (std::size_t i = 0; i < thief_count; ++i) {
+			thieves.emplace_back([&]() {
+				std::size_t item;
+				while (!finished.load(std::memory_order_acquire)) {
+					if (deque.pop_front(item)) {
+						take(item);
+					}
+				}
+			});
+		}
+
+		// Owner: bursts of pushes (forcing growth) followed by some pops
+		std::size_t item;
+		for (std::size_t next = 0; next < item_count; ) {
+			const std::size_t burst = std::min<std::size_t>(1 + next % 300, item_count - next);
+			for (std::size_t i = 0; i < burst; ++i) {
+				deque.push_back(next++);
+			}
+			for (std::size_t i = 0; i < burst / 2; ++i) {
+				if (deque.pop_back(item)) {
+					take(item);
+				}
+			}
+		}
+		while (deque.pop_back(item)) {
+			take(item);
+		}
+		finished.store(true, std::memory_order_release);
+		thieves.clear(); // Join
+
+		for (auto& t : taken) {
+			if (1 != t.load()) {
+				state.SkipWithError("item lost or taken twice");
+				break;
+			}
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * item_count);
+}
+BENCHMARK(benchmark_chase_lev_deque_stress)
+->Unit(benchmark::kMillisecond)
+->Arg(1)->Arg(3)->Arg(7);
+
+// Publication buffers under neighbor reads: one writer keeps publishing a
+// 30-d position, readers keep taking the latest one. Reports reads.
+// Args: [reader_count]
+template <typename buffer_t>
+static void benchmark_publication_buffer(benchmark::State& state) {
+	constexpr std::size_t dimension = 30;
+	constexpr std::size_t write_count = 1 << 16;
+	const auto reader_count = static_cast<std::size_t>(state.range(0));
+
+	std::size_t total_reads = 0;
+	for (auto _ : state) {
+		buffer_t buffer;
+		if constexpr (requires { buffer.resize(dimension); }) {
+			buffer.resize(dimension);
+		}
+		std::vector<double> position(dimension, 0.);
+		buffer.put(std::span<const double>{ position });
+		std::atomic<bool> finished{ false };
+		std::atomic<std::size_t> reads{ 0 };
+
+		std::vector<std::jthread> readers;
+		for (std::size_t i = 0; i < reader_count; ++i) {
+			readers.emplace_back([&]() {
+				std::size_t n = 0;
+				while (!finished.load(std::memory_order_acquire)) {
+					auto viewer = buffer.get();
+					benchmark::DoNotOptimize(std::data(*viewer)[dimension - 1]);
+					++n;
+				}
+				reads.fetch_add(n, std::memory_order_relaxed);
+			});
+		}
+
+		for (std::size_t w = 0; w < write_count; ++w) {
+			position[w % dimension] += 1.;
+			buffer.put(std::span<const double>{ position });
+		}
+		finished.store(true, std::memory_order_release);
+		readers.clear(); // Join
+		total_reads += reads.load();
+	}
+	state.SetItemsProcessed(total_reads);
+}
+BENCHMARK_TEMPLATE(benchmark_publication_buffer, hungbiu::spmc_buffer<vec_t>)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Arg(1)->Arg(3)->Arg(7);
+BENCHMARK_TEMPLATE(benchmark_publication_buffer, hungbiu::naive_spmc_buffer<vec_t>)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Arg(1)->Arg(3)->Arg(7);
+BENCHMARK_TEMPLATE(benchmark_publication_buffer, hungbiu::seqlock_buffer<std::array<double, 30>>)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Arg(1)->Arg(3)->Arg(7);
+BENCHMARK_TEMPLATE(benchmark_publication_buffer, hungbiu::spmc_buffer<hungbiu::inline_payload<>>)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Arg(1)->Arg(3)->Arg(7);
+BENCHMARK_TEMPLATE(benchmark_publication_buffer, hungbiu::spmc_buffer<hungbiu::inline_payload<30>>)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Arg(1)->Arg(3)->Arg(7);
+
 
 // Bench speed of optimizing test functions suite
 // Args: [fork_count] [iter_per_task] [thread_count] [enable_stealing]
@@ -72,6 +193,170 @@ static void benchmark_papso(benchmark::State& state) {
     }        
 }
 // find the best stealing task granularity
+// Autotuned granularity against fixed ones, for a cheap and a costly objective
+// Args: [thread_count] [iter_per_task, 0: autotune]
+template <size_t Scale>
+static void benchmark_autotune(benchmark::State& state) {
+	const optimization_problem_t problem = scaled_rosenbrock<Scale>::problem;
+	hungbiu::hb_executor etor{ static_cast<size_t>(state.range(0)) };
+	const auto iter_per_task = static_cast<size_t>(state.range(1));
+
+	for (auto _ : state) {
+		auto result = papso::parallel_async_pso(etor, 0, iter_per_task, problem);
+		benchmark::DoNotOptimize(result.get());
+	}
+}
+BENCHMARK_TEMPLATE(benchmark_autotune, 1)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 8, 0 })->Args({ 8, 10 })->Args({ 8, 100 })->Args({ 8, 1000 });
+BENCHMARK_TEMPLATE(benchmark_autotune, 100)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 8, 0 })->Args({ 8, 10 })->Args({ 8, 100 })->Args({ 8, 1000 });
+
+// Bulk-synchronous against asynchronous PSO on the same threads, with the
+// mean best value found as a counter
+// Args: [thread_count] [synchronous]
+template <size_t Scale>
+static void benchmark_sync_async(benchmark::State& state) {
+	const optimization_problem_t problem = scaled_rosenbrock<Scale>::problem;
+	const auto thread_count = static_cast<size_t>(state.range(0));
+	hungbiu::hb_executor etor{ state.range(1) ? 1 : thread_count };
+	papso_options_t options;
+
+	double best = 0.;
+	for (auto _ : state) {
+		options.seed = state.iterations();
+		auto result = state.range(1)
+			? sync_pso::optimize(problem, options, thread_count)
+			: papso::parallel_async_pso(etor, thread_count, 100, problem, options).get();
+		best += std::get<0>(result);
+	}
+	state.counters["best"] = benchmark::Counter(best, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK_TEMPLATE(benchmark_sync_async, 1)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 4, 0 })->Args({ 4, 1 })->Args({ 8, 0 })->Args({ 8, 1 });
+BENCHMARK_TEMPLATE(benchmark_sync_async, 50)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 4, 0 })->Args({ 4, 1 })->Args({ 8, 0 })->Args({ 8, 1 });
+
+// Cost of the epoch barriers of the deterministic mode
+// Args: [thread_count] [iter_per_task] [deterministic]
+template <size_t Scale>
+static void benchmark_deterministic(benchmark::State& state) {
+	const optimization_problem_t problem = scaled_rosenbrock<Scale>::problem;
+	hungbiu::hb_executor etor{ static_cast<size_t>(state.range(0)) };
+	const auto iter_per_task = static_cast<size_t>(state.range(1));
+	papso_options_t options;
+	options.seed = 1;
+	options.deterministic = 0 != state.range(2);
+
+	for (auto _ : state) {
+		auto result = papso::parallel_async_pso(etor, 8, iter_per_task, problem, options);
+		benchmark::DoNotOptimize(result.get());
+	}
+}
+BENCHMARK_TEMPLATE(benchmark_deterministic, 1)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 8, 10, 0 })->Args({ 8, 10, 1 })->Args({ 8, 100, 0 })->Args({ 8, 100, 1 });
+BENCHMARK_TEMPLATE(benchmark_deterministic, 50)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 8, 10, 0 })->Args({ 8, 10, 1 })->Args({ 8, 100, 0 })->Args({ 8, 100, 1 });
+
+// Swarm layouts, for a cheap objective (each scalar call copies an SoA
+// row) and a batch one (SoA rows are evaluated in place)
+// Args: [thread_count] [batch]
+template <typename storage_t>
+static void benchmark_swarm_storage(benchmark::State& state) {
+	using papso_t = basic_papso<hungbiu::spmc_buffer<hungbiu::inline_payload<>>, 2, 40, 5000, storage_t>;
+	static constexpr batch_func_t batch_rosenbrock = [](const double* positions, size_t count
+		, size_t dimension, size_t stride, double* values) {
+		for (size_t i = 0; i < count; ++i) {
+			const double* x = positions + i * stride;
+			double sum = 0;
+			for (size_t j = 0; j + 1 < dimension; ++j) {
+				const double t = x[j + 1] - x[j] * x[j];
+				sum += 100 * t * t + x[j] * x[j];
+			}
+			values[i] = sum;
+		}
+	};
+	hungbiu::hb_executor etor{ static_cast<size_t>(state.range(0)) };
+
+	for (auto _ : state) {
+		if (state.range(1)) {
+			const batch_optimization_problem_t problem{ batch_rosenbrock, test_functions::bounds[2], test_functions::dimensions[2] };
+			benchmark::DoNotOptimize(papso_t::parallel_async_pso(etor, 8, 100, problem).get());
+		}
+		else {
+			benchmark::DoNotOptimize(papso_t::parallel_async_pso(etor, 8, 100, scaled_rosenbrock<1>::problem).get());
+		}
+	}
+}
+BENCHMARK_TEMPLATE(benchmark_swarm_storage, aos_swarm_storage)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 8, 0 })->Args({ 8, 1 });
+BENCHMARK_TEMPLATE(benchmark_swarm_storage, soa_swarm_storage)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 8, 0 })->Args({ 8, 1 });
+
+// Sequential baseline against papso on one subswarm
+// Args: [sequential] [iteration per task]
+template <size_t Scale>
+static void benchmark_sequential_baseline(benchmark::State& state) {
+	const optimization_problem_t problem = scaled_rosenbrock<Scale>::problem;
+	hungbiu::hb_executor etor{ 1 };
+	const auto iter_per_task = static_cast<size_t>(state.range(1));
+
+	for (auto _ : state) {
+		if (state.range(0)) {
+			benchmark::DoNotOptimize(sequential_pso::optimize(problem, {}, iter_per_task));
+		}
+		else {
+			auto result = papso::parallel_async_pso(etor, 1, iter_per_task, problem);
+			benchmark::DoNotOptimize(result.get());
+		}
+	}
+}
+BENCHMARK_TEMPLATE(benchmark_sequential_baseline, 1)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 1, 100 })->Args({ 0, 100 })->Args({ 0, 5000 });
+BENCHMARK_TEMPLATE(benchmark_sequential_baseline, 50)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 1, 100 })->Args({ 0, 100 })->Args({ 0, 5000 });
+
+// Many small problems sharing one executor
+// Args: [job_count] [thread_count] [through a job_scheduler]
+static void benchmark_concurrent_jobs(benchmark::State& state) {
+	using papso_t = basic_papso<hungbiu::spmc_buffer<hungbiu::inline_payload<>>, 2, 40, 500>;
+
+	const auto job_count = static_cast<size_t>(state.range(0));
+	hungbiu::hb_executor etor{ static_cast<size_t>(state.range(1)) };
+	hungbiu::job_scheduler scheduler{ etor };
+	const optimization_problem_t problem = scaled_rosenbrock<1>::problem;
+
+	std::vector<papso_t::papso_result_t> results;
+	results.reserve(job_count);
+	for (auto _ : state) {
+		for (size_t i = 0; i < job_count; ++i) {
+			papso_options_t options;
+			if (state.range(2)) {
+				options.job = scheduler.make_job(static_cast<int>(i % 2));
+			}
+			results.push_back(papso_t::parallel_async_pso(etor, 4, 50, problem, options));
+		}
+		for (auto& result : results) {
+			benchmark::DoNotOptimize(result.get(etor));
+		}
+		results.clear();
+	}
+	state.SetItemsProcessed(state.iterations() * job_count);
+}
+BENCHMARK(benchmark_concurrent_jobs)
+->Unit(benchmark::kMillisecond)->UseRealTime()
+->Args({ 100, 4, 0 })
+->Args({ 100, 4, 1 });
+
 //BENCHMARK(benchmark_papso)
 //->Iterations(1)
 //->Repetitions(10)
@@ -117,6 +402,26 @@ static void benchmark_test_functions(benchmark::State& state) {
 //BENCHMARK(benchmark_test_functions)
 //->Arg(0)->Arg(1)->Arg(2)->Arg(3)->Arg(4)->Arg(5)->Arg(6)->Arg(7);
 
+// Args: [function idx]
+static void benchmark_test_functions_simd(benchmark::State& state) {
+	const auto idx = state.range(0);
+	const auto dim = test_functions::dimensions[idx];
+	const auto min = test_functions::bounds[idx].first;
+	const auto max = test_functions::bounds[idx].second;
+	const auto diff = max - min;
+	canonical_rng rng;
+
+	std::vector<double> vec(dim);
+	std::generate(vec.begin(), vec.end(), [&]() {
+		return min + rng() * diff;	});
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(test_functions::simd_functions[idx](vec.cbegin(), vec.cend()));
+	}
+}
+//BENCHMARK(benchmark_test_functions_simd)
+//->Arg(0)->Arg(1)->Arg(2)->Arg(3)->Arg(4)->Arg(5)->Arg(6);
+
 
 
 template <int N> // N iteartions, Args: [fork_count] [itr_per_task] [dimensions] 
@@ -159,10 +464,9 @@ void benchmark_stealing_efficiency(benchmark::State& state) {
 //->Args({ 7, 100, 30 })
 //->Args({ 8, 100, 30 });
 
-// Args: [thread_count] [fork_count] [itr_per_task] [stealing]
-template <size_t NbSize>
+// Args: [thread_count] [fork_count] [itr_per_task] [stealing] [swarm_size]
 static void benchmark_stealing(benchmark::State& state) {	
-	using papso_t = basic_papso<hungbiu::spmc_buffer<vec_t>, 2, NbSize, 5000>;
+	using papso_t = basic_papso<hungbiu::spmc_buffer<vec_t>, 2, 48, 5000>;
 
 	const auto thread_count = state.range(0);
 	const auto fork_count = state.range(1);
@@ -171,51 +475,42 @@ static void benchmark_stealing(benchmark::State& state) {
 	// Bench
 	optimization_problem_t problem = scaled_rosenbrock<50>::problem;
 	hungbiu::hb_executor etor(thread_count, state.range(3));
+	papso_options_t options;
+	options.swarm_size = static_cast<size_t>(state.range(4));
 	for (auto _ : state) {
-		auto result = papso_t::parallel_async_pso(etor, fork_count, itr_per_task, problem);
+		auto result = papso_t::parallel_async_pso(etor, fork_count, itr_per_task, problem, options);
 		benchmark::DoNotOptimize(result.get());
 	}
 }
 
-//BENCHMARK_TEMPLATE(benchmark_stealing, 50)
+//BENCHMARK(benchmark_stealing)
 //->Unit(benchmark::kMillisecond)
 //->Repetitions(10)
-//->Args({ 3, 5, 250, 1 }) // WS
-//->Args({ 3, 5, 250, 0 }); // NO_WS
+//->Args({ 3, 5, 250, 1, 50 }) // WS
+//->Args({ 3, 5, 250, 0, 50 }); // NO_WS
 
 
-//BENCHMARK_TEMPLATE(benchmark_stealing, 75)
+//BENCHMARK(benchmark_stealing)
 //->Unit(benchmark::kMillisecond)
 //->Repetitions(1)
 //// WS
-//->Args({ 4, 15, 250, 1 })
+//->Args({ 4, 15, 250, 1, 75 })
 //// NO_WS
-//->Args({ 4, 15, 250, 0 });
+//->Args({ 4, 15, 250, 0, 75 });
 
 
-BENCHMARK_TEMPLATE(benchmark_stealing, 50)
-->Unit(benchmark::kMillisecond)
-->Repetitions(5)
-// WS
-->Args({ 7, 10, 500, 1 })
-// NO_WS
-->Args({ 7, 10, 500, 0 });
-
-BENCHMARK_TEMPLATE(benchmark_stealing, 80)
-->Unit(benchmark::kMillisecond)
-->Repetitions(5)
-// WS
-->Args({ 7, 16, 500, 1 })
-// NO_WS
-->Args({ 7, 16, 500, 0 });
-
-BENCHMARK_TEMPLATE(benchmark_stealing, 100)
+// One instantiation for every swarm size
+BENCHMARK(benchmark_stealing)
 ->Unit(benchmark::kMillisecond)
 ->Repetitions(5)
 // WS
-->Args({ 7, 20, 500, 1 }) 
+->Args({ 7, 10, 500, 1, 50 })
+->Args({ 7, 16, 500, 1, 80 })
+->Args({ 7, 20, 500, 1, 100 })
 // NO_WS
-->Args({ 7, 20, 500, 0 });
+->Args({ 7, 10, 500, 0, 50 })
+->Args({ 7, 16, 500, 0, 80 })
+->Args({ 7, 20, 500, 0, 100 });
 
 // Args: [fork_count]
 template <int sz> requires (sz > 0)
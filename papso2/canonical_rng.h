@@ -1,36 +1,157 @@
 /*
-* Random number generator with normal distribution within [0, 1)
-* Change this to a object?
+* Random number generator with uniform distribution within [0, 1)
+* Counter-based (Philox4x32-10, Salmon et al. 2011): the n-th number of a
+* stream is a pure function of (seed, stream, substream, n), so runs are
+* reproducible no matter which thread draws. The state is inline, blocks are
+* generated 4 at a time with AVX2 when available.
 */
 #ifndef _CANONICAL_RNG
 #define _CANONICAL_RNG
 #include <random>
-#include <memory>
-#include <new>
-#include <cstdlib>
-class canonical_rng
-{	
-	struct alignas(64) storage {
-		
-		std::mt19937 generator_;
-		std::uniform_real_distribution<double> real_distribute;
-	
-		storage() :
-			generator_(std::random_device{}())
-			, real_distribute(0., 1.) {}
-	};
-
-	std::unique_ptr<storage> storage_ptr_;
-	
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "cpu_features.h"
+
+class alignas(64) canonical_rng
+{
+	static constexpr std::uint32_t M0 = 0xD2511F53;
+	static constexpr std::uint32_t M1 = 0xCD9E8D57;
+	static constexpr std::uint32_t W0 = 0x9E3779B9;
+	static constexpr std::uint32_t W1 = 0xBB67AE85;
+	static constexpr std::size_t buffer_size = 8; // 4 blocks of 2 doubles
+
+	// key: seed; counter: [block, substream, stream(lo), stream(hi)]
+	std::uint32_t key_[2];
+	std::uint32_t stream_[2];
+	std::uint32_t substream_ = 0;
+	std::uint32_t block_ = 0;
+	std::size_t pos_ = buffer_size;
+	double buffer_[buffer_size];
+
+	// 52 random bits into [0, 1)
+	static double to_canonical(std::uint32_t hi, std::uint32_t lo) noexcept {
+		const std::uint64_t bits = 0x3FF0000000000000ull
+			| ((static_cast<std::uint64_t>(hi) << 32 | lo) >> 12);
+		double d;
+		std::memcpy(&d, &bits, sizeof(d));
+		return d - 1.;
+	}
+
+	void generate_scalar(double* out, std::size_t blocks) noexcept {
+		for (std::size_t b = 0; b < blocks; ++b, ++block_) {
+			std::uint32_t c[4] = { block_, substream_, stream_[0], stream_[1] };
+			std::uint32_t k0 = key_[0], k1 = key_[1];
+			for (int r = 0; r < 10; ++r) {
+				const std::uint64_t p0 = static_cast<std::uint64_t>(M0) * c[0];
+				const std::uint64_t p1 = static_cast<std::uint64_t>(M1) * c[2];
+				const std::uint32_t n0 = static_cast<std::uint32_t>(p1 >> 32) ^ c[1] ^ k0;
+				const std::uint32_t n2 = static_cast<std::uint32_t>(p0 >> 32) ^ c[3] ^ k1;
+				c[1] = static_cast<std::uint32_t>(p1);
+				c[3] = static_cast<std::uint32_t>(p0);
+				c[0] = n0;
+				c[2] = n2;
+				k0 += W0;
+				k1 += W1;
+			}
+			out[2 * b] = to_canonical(c[0], c[1]);
+			out[2 * b + 1] = to_canonical(c[2], c[3]);
+		}
+	}
+
+#if CPU_FEATURES_X86
+	static bool use_avx2() noexcept {
+		static const bool enabled = cpu_features::avx2();
+		return enabled;
+	}
+
+	// 4 blocks per step, every 32-bit word sits in the low half of a 64-bit lane
+	CPU_FEATURES_TARGET("avx2")
+	std::size_t generate_avx2(double* out, std::size_t blocks) noexcept {
+		const __m256i low = _mm256_set1_epi64x(0xFFFFFFFF);
+		const __m256i m0 = _mm256_set1_epi64x(M0);
+		const __m256i m1 = _mm256_set1_epi64x(M1);
+		const __m256i one = _mm256_set1_epi64x(0x3FF0000000000000ll);
+		const __m256d unit = _mm256_set1_pd(1.);
+
+		std::size_t b = 0;
+		for (; b + 4 <= blocks; b += 4, block_ += 4) {
+			__m256i c0 = _mm256_and_si256(_mm256_add_epi64(_mm256_set1_epi64x(block_), _mm256_setr_epi64x(0, 1, 2, 3)), low);
+			__m256i c1 = _mm256_set1_epi64x(substream_);
+			__m256i c2 = _mm256_set1_epi64x(stream_[0]);
+			__m256i c3 = _mm256_set1_epi64x(stream_[1]);
+			std::uint32_t k0 = key_[0], k1 = key_[1];
+			for (int r = 0; r < 10; ++r) {
+				const __m256i p0 = _mm256_mul_epu32(c0, m0);
+				const __m256i p1 = _mm256_mul_epu32(c2, m1);
+				const __m256i n0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p1, 32), c1), _mm256_set1_epi64x(k0));
+				const __m256i n2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p0, 32), c3), _mm256_set1_epi64x(k1));
+				c1 = _mm256_and_si256(p1, low);
+				c3 = _mm256_and_si256(p0, low);
+				c0 = n0;
+				c2 = n2;
+				k0 += W0;
+				k1 += W1;
+			}
+			// (hi << 32 | lo) >> 12 as the mantissa of [1, 2)
+			const __m256d d0 = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(one
+				, _mm256_srli_epi64(_mm256_or_si256(_mm256_slli_epi64(c0, 32), c1), 12))), unit);
+			const __m256d d1 = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(one
+				, _mm256_srli_epi64(_mm256_or_si256(_mm256_slli_epi64(c2, 32), c3), 12))), unit);
+			// Interleave to block order: b0.0 b0.1 b1.0 b1.1 | b2.0 b2.1 b3.0 b3.1
+			const __m256d lo = _mm256_unpacklo_pd(d0, d1);
+			const __m256d hi = _mm256_unpackhi_pd(d0, d1);
+			_mm256_storeu_pd(out + 2 * b, _mm256_permute2f128_pd(lo, hi, 0x20));
+			_mm256_storeu_pd(out + 2 * b + 4, _mm256_permute2f128_pd(lo, hi, 0x31));
+		}
+		return b;
+	}
+#endif
+
+	// Write `blocks` blocks (2 doubles each) and advance the counter
+	void generate(double* out, std::size_t blocks) noexcept {
+		std::size_t done = 0;
+#if CPU_FEATURES_X86
+		if (use_avx2()) {
+			done = generate_avx2(out, blocks);
+		}
+#endif
+		generate_scalar(out + 2 * done, blocks - done);
+	}
+
 public:
-	canonical_rng() : storage_ptr_(std::make_unique<storage>()) {}
-	canonical_rng(canonical_rng&& oth) noexcept
-		: storage_ptr_(std::move(oth.storage_ptr_)) {}
-	~canonical_rng() {}
+	// Non-reproducible seed
+	canonical_rng() : canonical_rng(std::random_device{}()) {}
+	explicit canonical_rng(std::uint64_t seed, std::uint64_t stream = 0) noexcept
+		: key_{ static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) }
+		, stream_{ static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32) } {}
+
+	// Restart at the beginning of `substream` of this stream
+	void seek(std::uint32_t substream) noexcept {
+		substream_ = substream;
+		block_ = 0;
+		pos_ = buffer_size;
+	}
+
+	inline double operator()() noexcept {
+		if (pos_ == buffer_size) {
+			generate(buffer_, buffer_size / 2);
+			pos_ = 0;
+		}
+		return buffer_[pos_++];
+	}
 
-	inline double operator()() const {
-		auto& s = *storage_ptr_;
-		return s.real_distribute(s.generator_);
+	// Draw a block of numbers at once, same sequence as repeated operator()
+	void fill(double* first, double* last) noexcept {
+		while (first != last && pos_ != buffer_size) {
+			*first++ = buffer_[pos_++];
+		}
+		const std::size_t blocks = (last - first) / 2;
+		generate(first, blocks);
+		first += 2 * blocks;
+		if (first != last) {
+			*first = operator()();
+		}
 	}
 };
-#endif
\ No newline at end of file
+#endif
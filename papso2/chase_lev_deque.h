@@ -0,0 +1,140 @@
+#ifndef _CHASE_LEV_DEQUE
+#define _CHASE_LEV_DEQUE
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+namespace hungbiu
+{
+	// Lock-free work-stealing deque (Chase & Lev 2005), with the C11 memory
+	// orderings of Le et al. 2013.
+	// Owner: push_back/pop_back (LIFO); thieves: pop_front (FIFO) via CAS on top.
+	// Thieves read a slot before their CAS, so T must be trivially copyable
+	// (tasks are stored by pointer). Retired rings are kept until destruction
+	// because a thief may still read from them.
+	template <typename T>
+	requires std::is_trivially_copyable_v<T>
+	class chase_lev_deque
+	{
+		using index_t = std::int64_t;
+
+		class ring {
+			index_t mask_;
+			std::unique_ptr<std::atomic<T>[]> slots_;
+		public:
+			explicit ring(index_t capacity) :
+				mask_(capacity - 1), slots_(std::make_unique<std::atomic<T>[]>(capacity)) {}
+
+			index_t capacity() const noexcept { return mask_ + 1; }
+			T load(index_t i) const noexcept {
+				return slots_[i & mask_].load(std::memory_order_relaxed);
+			}
+			void store(index_t i, T v) noexcept {
+				slots_[i & mask_].store(v, std::memory_order_relaxed);
+			}
+			std::unique_ptr<ring> grow(index_t top, index_t bottom) const {
+				auto bigger = std::make_unique<ring>(2 * capacity());
+				for (index_t i = top; i < bottom; ++i) {
+					bigger->store(i, load(i));
+				}
+				return bigger;
+			}
+		};
+
+		alignas(64) std::atomic<index_t> top_{ 0 };
+		alignas(64) std::atomic<index_t> bottom_{ 0 };
+		alignas(64) std::atomic<ring*> ring_{ nullptr };
+		std::vector<std::unique_ptr<ring>> rings_; // Owner only, the last one is current
+
+	public:
+		static constexpr index_t initial_capacity = 64; // Power of 2
+
+		chase_lev_deque()
+		{
+			rings_.push_back(std::make_unique<ring>(initial_capacity));
+			ring_.store(rings_.back().get(), std::memory_order_relaxed);
+		}
+		~chase_lev_deque() = default;
+		chase_lev_deque(chase_lev_deque&& oth) noexcept // Not thread-safe, only for containers
+			: top_(oth.top_.load())
+			, bottom_(oth.bottom_.exchange(oth.top_.load())) // Leave `oth` empty
+			, ring_(oth.ring_.exchange(nullptr))
+			, rings_(std::move(oth.rings_)) {}
+		chase_lev_deque& operator=(chase_lev_deque&&) = delete;
+
+		// Owner only
+		void push_back(T v)
+		{
+			const index_t b = bottom_.load(std::memory_order_relaxed);
+			const index_t t = top_.load(std::memory_order_acquire);
+			ring* r = ring_.load(std::memory_order_relaxed);
+			if (b - t > r->capacity() - 1) { // Full
+				rings_.push_back(r->grow(t, b));
+				r = rings_.back().get();
+				ring_.store(r, std::memory_order_release);
+			}
+			r->store(b, v);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom_.store(b + 1, std::memory_order_relaxed);
+		}
+
+		// Owner only
+		[[nodiscard]] bool pop_back(T& v) noexcept
+		{
+			const index_t b = bottom_.load(std::memory_order_relaxed) - 1;
+			ring* r = ring_.load(std::memory_order_relaxed);
+			bottom_.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			index_t t = top_.load(std::memory_order_relaxed);
+
+			if (t > b) { // Empty
+				bottom_.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+
+			v = r->load(b);
+			if (t == b) { // Last item, race against thieves
+				const bool won = top_.compare_exchange_strong(t, t + 1
+					, std::memory_order_seq_cst, std::memory_order_relaxed);
+				bottom_.store(b + 1, std::memory_order_relaxed);
+				return won;
+			}
+			return true;
+		}
+
+		// Any thread
+		[[nodiscard]] bool pop_front(T& v) noexcept
+		{
+			index_t t = top_.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const index_t b = bottom_.load(std::memory_order_acquire);
+			if (t >= b) { // Empty
+				return false;
+			}
+
+			ring* r = ring_.load(std::memory_order_acquire);
+			T x = r->load(t);
+			if (!top_.compare_exchange_strong(t, t + 1
+				, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return false; // Lost the race to another thief or the owner
+			}
+			v = x;
+			return true;
+		}
+
+		// Approximate, any thread
+		std::size_t size() const noexcept
+		{
+			const index_t b = bottom_.load(std::memory_order_relaxed);
+			const index_t t = top_.load(std::memory_order_relaxed);
+			return b > t ? static_cast<std::size_t>(b - t) : 0;
+		}
+		bool empty() const noexcept
+		{
+			return 0 == size();
+		}
+	};
+} // end namespace hungbiu
+
+#endif // _CHASE_LEV_DEQUE
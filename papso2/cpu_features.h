@@ -0,0 +1,49 @@
+/*
+* Runtime detection of x86 vector extensions
+*/
+#ifndef _CPU_FEATURES
+#define _CPU_FEATURES
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CPU_FEATURES_X86 1
+#define CPU_FEATURES_TARGET(isa)
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_FEATURES_X86 1
+#define CPU_FEATURES_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CPU_FEATURES_X86 0
+#define CPU_FEATURES_TARGET(isa)
+#endif
+
+struct cpu_features {
+#if CPU_FEATURES_X86
+#ifdef _MSC_VER
+	// OS must save the extended register state too (XCR0)
+	static bool os_supports(unsigned long long xcr0_mask) noexcept {
+		int info[4];
+		__cpuid(info, 1);
+		const bool osxsave = info[2] & (1 << 27);
+		return osxsave && (_xgetbv(0) & xcr0_mask) == xcr0_mask;
+	}
+	static bool avx2() noexcept {
+		int info[4];
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) && os_supports(0x6);
+	}
+	static bool avx512f() noexcept {
+		int info[4];
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 16)) && os_supports(0xE6);
+	}
+#else
+	static bool avx2() noexcept { return __builtin_cpu_supports("avx2"); }
+	static bool avx512f() noexcept { return __builtin_cpu_supports("avx512f"); }
+#endif
+#else
+	static bool avx2() noexcept { return false; }
+	static bool avx512f() noexcept { return false; }
+#endif
+};
+
+#endif
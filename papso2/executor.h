@@ -2,43 +2,230 @@
 #define _EXECUTOR
 #include <memory>
 #include <type_traits>
+#include <utility>
 #include <vector>
 #include <cstddef>
 #include <random>
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <variant>
+#include <exception>
+#include <functional>
 #include <concepts>
 #include <future>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
-#ifdef _MSC_VER
-#define NOMINMAX
-#include <windows.h>
-#include <processthreadsapi.h>
-#include <winbase.h>
-#endif
 #include "concurrent_std_deque.h"
+#include "chase_lev_deque.h"
+#include "topology.h"
 
 // lazy spin up + cv
 namespace hungbiu
 {	
+	// How a thief picks its victims
+	enum class steal_policy {
+		linear,       // idx + 1, idx + 2, ...
+		randomized,   // Random start, then everyone in turn
+		hierarchical, // SMT siblings, same package, same node, the rest; random start in each
+		last_victim   // Whoever we last robbed, then randomized
+	};
+
+	struct executor_options_t {
+		bool enable_stealing = true;
+		placement_t placement;
+		steal_policy policy = steal_policy::hierarchical;
+		bool steal_half = true; // Take half of the victim's stack, not one task
+		size_t guest_slots = 1; // Outside threads that may join at once, see help_until()
+	};
+
+	// Shared state of a task_future: no mutex and no condition variable, freed
+	// states are kept on a per-thread list and reused by the next execute_return
+	template <typename R>
+	class future_state
+	{
+		using value_t = std::conditional_t<std::is_void_v<R>, std::monostate, R>;
+
+		std::atomic<unsigned> refs_{ 2 }; // Future and promise
+		std::atomic<bool> ready_{ false };
+		std::optional<value_t> value_;
+		std::exception_ptr error_;
+		future_state* next_free_ = nullptr;
+
+		struct free_list {
+			future_state* head = nullptr;
+			~free_list() {
+				while (head) {
+					delete std::exchange(head, head->next_free_);
+				}
+			}
+		};
+		static free_list& pool() {
+			static thread_local free_list list;
+			return list;
+		}
+
+	public:
+		static future_state* make() {
+			auto& list = pool();
+			if (!list.head) {
+				return new future_state;
+			}
+			future_state* s = std::exchange(list.head, list.head->next_free_);
+			s->refs_.store(2, std::memory_order_relaxed);
+			s->ready_.store(false, std::memory_order_relaxed);
+			return s;
+		}
+		static void release(future_state* s) noexcept {
+			if (1 != s->refs_.fetch_sub(1, std::memory_order_acq_rel)) {
+				return;
+			}
+			s->value_.reset();
+			s->error_ = nullptr;
+			auto& list = pool();
+			s->next_free_ = list.head;
+			list.head = s;
+		}
+
+		template <typename... Args>
+		void set_value(Args&&... args) {
+			value_.emplace(std::forward<Args>(args)...);
+			ready_.store(true, std::memory_order_release);
+			ready_.notify_all();
+		}
+		void set_error(std::exception_ptr e) noexcept {
+			error_ = std::move(e);
+			ready_.store(true, std::memory_order_release);
+			ready_.notify_all();
+		}
+		bool ready() const noexcept {
+			return ready_.load(std::memory_order_acquire);
+		}
+		void wait() const noexcept {
+			ready_.wait(false, std::memory_order_acquire);
+		}
+		R take() {
+			if (error_) {
+				std::rethrow_exception(error_);
+			}
+			if constexpr (!std::is_void_v<R>) {
+				return std::move(*value_);
+			}
+		}
+	};
+
+	// Returned by execute_return; get() may be called once. Like std::future,
+	// wait() and get() throw future_error(no_state) without a state (the
+	// executor was done, or get() was already called)
+	template <typename R>
+	class task_future
+	{
+		future_state<R>* state_ = nullptr;
+	public:
+		task_future() = default;
+		explicit task_future(future_state<R>* s) noexcept : state_(s) {}
+		task_future(task_future&& oth) noexcept : state_(std::exchange(oth.state_, nullptr)) {}
+		task_future& operator=(task_future&& rhs) noexcept {
+			if (this != &rhs) {
+				if (state_) future_state<R>::release(state_);
+				state_ = std::exchange(rhs.state_, nullptr);
+			}
+			return *this;
+		}
+		~task_future() {
+			if (state_) future_state<R>::release(state_);
+		}
+
+		bool valid() const noexcept { return state_; }
+		bool ready() const noexcept { return state_ && state_->ready(); }
+		void wait() const {
+			if (!state_) {
+				throw std::future_error(std::future_errc::no_state);
+			}
+			state_->wait();
+		}
+		R get() {
+			wait();
+			auto s = std::exchange(state_, nullptr);
+			struct releaser {
+				future_state<R>* s;
+				~releaser() { future_state<R>::release(s); }
+			} guard{ s };
+			return s->take();
+		}
+	};
+
+	// Task side of a task_future; a task dropped without running breaks it
+	template <typename R>
+	class task_promise
+	{
+		future_state<R>* state_;
+	public:
+		explicit task_promise(future_state<R>* s) noexcept : state_(s) {}
+		task_promise(task_promise&& oth) noexcept : state_(std::exchange(oth.state_, nullptr)) {}
+		task_promise& operator=(task_promise&&) = delete;
+		~task_promise() {
+			if (!state_) {
+				return;
+			}
+			if (!state_->ready()) {
+				state_->set_error(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+			}
+			future_state<R>::release(state_);
+		}
+
+		template <typename F, typename... Args>
+		void run(F& f, Args&... args) {
+			try {
+				if constexpr (std::is_void_v<R>) {
+					std::invoke(f, args...);
+					state_->set_value();
+				}
+				else {
+					state_->set_value(std::invoke(f, args...));
+				}
+			}
+			catch (...) {
+				state_->set_error(std::current_exception());
+			}
+		}
+	};
+
 	class hb_executor
 	{			
 	public:	// Template aliases used by hb_executor
 		template <typename T>
 		using promise_t = std::promise<T>;
+#ifdef COUNT_STEALING
+		struct steal_stats_t {
+			size_t attempts = 0; // Victims probed
+			size_t steals = 0;   // Probes that got work
+			size_t tasks = 0;    // Tasks taken, batches included
+			size_t remote = 0;   // Steals from another package or an unpinned worker
+		};
+#endif
 		template <typename T>
-		using future_t = std::future<T>;
+		using future_t = task_future<T>;
 		class worker_handle; // Forward declaration
 
 	private:
-		// r_task_wrapper: provide aysnc result
-		template <typename R>
-		using r_task_wrapper = std::packaged_task<R(worker_handle&)>;
+		// r_task_wrapper: provide aysnc result through a task_future
 		template <typename F, typename R>
-		static r_task_wrapper<R> make_task(F&& func)
+		struct r_task_wrapper
+		{
+			F func_;
+			task_promise<R> promise_;
+			void operator()(worker_handle& h)
+			{
+				promise_.run(func_, h);
+			}
+		};
+		template <typename F, typename R>
+		static auto make_task(F&& func, future_state<R>* state)
 		{
 			using F_decay = std::decay_t<F>;
-			return r_task_wrapper<R>(std::forward<F_decay>(func));
+			return r_task_wrapper<F_decay, R>{ std::forward<F>(func), task_promise<R>{ state } };
 		}
 
 		// task_wrapper: does not provide async result & SSO
@@ -164,9 +351,77 @@ namespace hungbiu
 			}
 		};
 
+		// Per-worker pool of stack nodes. Only the owner takes nodes; a node
+		// freed by another thread (a thief) goes back through `remote_`
+		class task_slab
+		{
+			struct node {
+				std::aligned_storage_t<sizeof(task_wrapper), alignof(task_wrapper)> task; // Must be first
+				task_slab* owner;
+				node* next;
+			};
+			static constexpr std::size_t chunk_size = 64;
+
+			node* free_ = nullptr;
+			alignas(64) std::atomic<node*> remote_{ nullptr };
+			std::vector<std::unique_ptr<node[]>> chunks_;
+
+			node* acquire()
+			{
+				if (!free_) {
+					free_ = remote_.exchange(nullptr, std::memory_order_acquire);
+				}
+				if (!free_) { // Grows until the steady state, then never again
+					auto& chunk = chunks_.emplace_back(std::make_unique<node[]>(chunk_size));
+					for (std::size_t i = 0; i < chunk_size; ++i) {
+						chunk[i].owner = this;
+						chunk[i].next = i + 1 < chunk_size ? &chunk[i + 1] : nullptr;
+					}
+					free_ = chunk.get();
+				}
+				return std::exchange(free_, free_->next);
+			}
+			void release(node* n, const task_slab& current) noexcept
+			{
+				if (this == &current) {
+					n->next = free_;
+					free_ = n;
+					return;
+				}
+				node* head = remote_.load(std::memory_order_relaxed);
+				do {
+					n->next = head;
+				} while (!remote_.compare_exchange_weak(head, n
+					, std::memory_order_release, std::memory_order_relaxed));
+			}
+
+		public:
+			task_slab() = default;
+			task_slab(task_slab&&) noexcept {} // Only before use: nodes point back at their slab
+			task_slab& operator=(task_slab&&) = delete;
+
+			// Owner thread only
+			template <typename F>
+			task_wrapper* make(F&& func)
+			{
+				node* n = acquire();
+				return new (&n->task) task_wrapper(std::forward<F>(func));
+			}
+			// `current`: slab of the calling thread
+			static void destroy(task_wrapper* p, const task_slab& current) noexcept
+			{
+				node* n = reinterpret_cast<node*>(p);
+				p->~task_wrapper();
+				n->owner->release(n, current);
+			}
+		};
+
 		class worker; // Forward declaration because worker::get_handle() return a woker_handle object;
 					  // Have to be PRIVATE
 	public:		
+		// Type-erased task, for layers that queue tasks before submitting them
+		using task_t = task_wrapper;
+
 		// --------------------------------------------------------------------------------
 		// worker_handler
 		// used by task object to submit work
@@ -185,18 +440,11 @@ namespace hungbiu
 				return *this;
 			}
 
-			template <typename T>
-			static bool future_ready(const std::future<T>& fut)
-			{
-				const auto status = fut.wait_for(std::chrono::nanoseconds{ 0 });
-				return std::future_status::ready == status;
-			}
-
 			// Suspend current task to execute others
 			template <typename R>
 			R get(future_t<R>& fut)
 			{
-				while (!future_ready(fut)) {
+				while (!fut.ready()) {
 					task_wrapper tw{};
 					if (ptr_worker_->_pop(tw) ||
 						ptr_worker_->_steal(tw)) {
@@ -213,10 +461,9 @@ namespace hungbiu
 			requires std::invocable<F, hb_executor::worker_handle&>
 				[[nodiscard]] future_t<R> execute_return(F&& func) const
 			{
-				auto t = make_task<F, R>(std::forward<F>(func));
-				auto fut = t.get_future();
-				ptr_worker_->_push(std::move(t));
-				return fut;
+				auto state = future_state<R>::make();
+				ptr_worker_->_push(make_task<F, R>(std::forward<F>(func), state));
+				return future_t<R>{ state };
 			}
 
 			// Submit a task to current thread and doesn't return result
@@ -236,63 +483,148 @@ namespace hungbiu
 		class alignas(64) worker
 		{
 			friend class worker_handle;
+			friend class hb_executor; // Builds victim lists, reads counters
 			template <typename T>
-			using deque_t = concurrent_std_deque<T>;//concurrent_std_deque<T>;
+			using deque_t = chase_lev_deque<T>;//concurrent_std_deque<T>;
 
 			hb_executor* etor_;
 			std::size_t index_;
-			deque_t<task_wrapper> run_stack_;
+			deque_t<task_wrapper*> run_stack_; // Owner pushes/pops, others steal
+			task_slab slab_; // Nodes of run_stack_
+			concurrent_std_deque<task_wrapper> inbox_; // Tasks assigned from outside the pool
 			std::condition_variable_any cv_;
 			std::mutex mtx_; // use this mutex to wait for condition
 
-			// Waiting, Ready, Running
-			// `Waiting` -> `Ready`:   Dispatcher makes a worker `Ready` after assigning task to it;
-			// `Ready` -> `Running`:   Worker makes itself run when resume from waiting on cv
-			// `Running` -> `Waiting`: Worker waits on cv if it can't find any task
-			//static constexpr unsigned Waiting = 0b0001; // Waiting for task
-			//static constexpr unsigned Pending = 0b0010; // Has pending task
-			//static constexpr unsigned Running = 0b0100; // Executing task
-
-			alignas(64) unsigned pending_{ 0 };
+			// Parking protocol
+			// Running -> Spinning: no task found, retry up to `spin_rounds` times
+			// Spinning -> Parked:  set `sleeping_`, count in `sleeper_count_`, look for
+			//                      work once more without `mtx_` (a batch steal wakes
+			//                      another worker under its `mtx_`), then wait on cv
+			//                      for `pending_`
+			// Parked -> Running:   `pending_` is set by dispatch, by a push of another
+			//                      worker while someone sleeps, or by shutdown
+			static constexpr unsigned spin_rounds = 64;
+
+			alignas(64) unsigned pending_{ 0 }; // Guarded by mtx_
+			std::atomic<bool> sleeping_{ false };
 			rng_t rng_;
 
-			// Push a forked task onto stack
-			void _push(task_wrapper tw)
+			// Other workers, closest first; victim_levels_ holds the end of
+			// every group of equally distant victims
+			std::vector<std::size_t> victims_;
+			std::vector<std::size_t> victim_levels_;
+			std::size_t last_victim_ = static_cast<std::size_t>(-1);
+			static constexpr std::size_t max_steal_batch = 32;
+
+#ifdef COUNT_STEALING
+			struct {
+				std::atomic<size_t> attempts{ 0 };
+				std::atomic<size_t> steals{ 0 };
+				std::atomic<size_t> tasks{ 0 };
+				std::atomic<size_t> remote{ 0 };
+			} counters_;
+#endif
+
+			// Push a forked task onto stack, built in place in a slab node
+			template <typename F>
+			void _push(F&& func)
+			{
+				run_stack_.push_back(slab_.make(std::forward<F>(func)));
+				etor_->wake_sleeper(index_);
+			}
+			// Take the task out of a stack node, `current`: worker of the calling thread
+			static void _unbox(task_wrapper* p, task_wrapper& tw, const worker& current) noexcept
 			{
-				run_stack_.push_back(tw); // Notify one?
+				tw = std::move(*p);
+				task_slab::destroy(p, current.slab_);
 			}
 			// Pop a task from stack for the worker itself to execute
 			[[nodiscard]] bool _pop(task_wrapper& tw) noexcept
 			{
-				return run_stack_.pop_back(tw);
+				task_wrapper* p = nullptr;
+				if (run_stack_.pop_back(p)) {
+					_unbox(p, tw, *this);
+					return true;
+				}
+				return inbox_.pop_front(tw);
 			}
 			[[nodiscard]] bool _steal(task_wrapper& tw)
 			{
 				return etor_->steal(tw, index_, &rng_);
 			}
+			// Returns true if work showed up while announcing sleep
+			bool _park(std::stop_token& stoken, task_wrapper& tw)
+			{
+				{
+					std::lock_guard guard{ mtx_ };
+					if (pending_) { // Notified while spinning
+						pending_ = 0;
+						return false;
+					}
+					sleeping_.store(true, std::memory_order_seq_cst);
+				}
+				etor_->sleeper_count_.fetch_add(1, std::memory_order_seq_cst);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				// Pairs with the fence in wake_sleeper(): either the pusher sees us
+				// sleeping, or we see its task here. A notification in between
+				// leaves `pending_` set, so the wait below returns at once
+				const bool found = _pop(tw) || (etor_->enable_stealing_ && _steal(tw));
+				std::unique_lock lock{ mtx_ };
+				if (!found) {
+					cv_.wait(lock, stoken, [this]() {
+						return pending_ || etor_->is_done();
+					});
+				}
+
+				pending_ = 0;
+				etor_->sleeper_count_.fetch_sub(1, std::memory_order_seq_cst);
+				sleeping_.store(false, std::memory_order_relaxed);
+				return found;
+			}
 		public:
 			//static constexpr auto RUN_QUEUE_SIZE = 256u;
 			worker(hb_executor& etor, std::size_t idx) :
-				etor_(&etor), index_(idx) {}
-			~worker() {}
+				etor_(&etor), index_(idx), rng_(static_cast<rng_t::result_type>(idx + 1)) {}
+			~worker()
+			{
+				drain();
+			}
+			// Threads are joined by now, drop tasks that never ran. Nodes may
+			// belong to other workers' slabs, so the executor drains every
+			// worker before destroying any
+			void drain() noexcept
+			{
+				task_wrapper* p = nullptr;
+				while (run_stack_.pop_back(p)) {
+					task_slab::destroy(p, slab_);
+				}
+			}
 			worker(worker&& oth) noexcept // Should not be used, only for vector
 				: etor_(std::exchange(oth.etor_, nullptr))
 				, index_(std::exchange(oth.index_, -1))
 				, run_stack_(std::move(oth.run_stack_))
+				, slab_(std::move(oth.slab_))
+				, inbox_(std::move(oth.inbox_))
 				/*, state_(oth.state_)*/
-				, rng_(std::move(oth.rng_)) {}
+				, rng_(std::move(oth.rng_))
+				, victims_(std::move(oth.victims_))
+				, victim_levels_(std::move(oth.victim_levels_))
+				, last_victim_(oth.last_victim_) {}
 			worker& operator=(const worker&) = delete;
 
 			void operator()(std::stop_token stoken)
 			{
 				auto h = get_handle();
 				const bool enable_stealing = etor_->enable_stealing_;
+				unsigned idle_rounds = 0;
 				while (!etor_->is_done() && !stoken.stop_requested()) {
 					// This task wrapper must be destroyed at the end of the loop
 					task_wrapper tw;
 
 					// get work from local stack 
 					if (_pop(tw)) {
+						idle_rounds = 0;
 						tw.run(h);
 						continue;
 					}
@@ -300,22 +632,49 @@ namespace hungbiu
 					// steal from others
 					if (enable_stealing) {
 						if (etor_->steal(tw, index_, &rng_)) {
+							idle_rounds = 0;
 							tw.run(h);
 							continue;
 						}
 					}
 
-					// Give up time slice
-					std::this_thread::yield();
+					// Give up time slice, sleep after spinning for a while
+					if (++idle_rounds < spin_rounds) {
+						std::this_thread::yield();
+						continue;
+					}
+					idle_rounds = 0;
+					if (_park(stoken, tw)) {
+						tw.run(h);
+					}
 				} // End of while loop
 			}
 			void assign(task_wrapper& tw)
 			{
-				run_stack_.push_front(tw);
+				inbox_.push_back(tw);
 			}
-			[[nodiscard]] bool try_steal(task_wrapper& tw) noexcept
+			// Called by `thief` on its own thread; with `half`, up to half of the
+			// stack moves to the thief's stack. Returns the number of tasks taken
+			[[nodiscard]] std::size_t try_steal(task_wrapper& tw, worker& thief, bool half)
 			{
-				return run_stack_.pop_front(tw);
+				task_wrapper* p = nullptr;
+				if (!run_stack_.pop_front(p)) {
+					return inbox_.pop_front(tw) ? 1 : 0;
+				}
+				_unbox(p, tw, thief);
+
+				std::size_t taken = 1;
+				if (half) {
+					const std::size_t extra = std::min(run_stack_.size() / 2, max_steal_batch - 1);
+					for (std::size_t i = 0; i < extra && run_stack_.pop_front(p); ++i) {
+						thief.run_stack_.push_back(p);
+						++taken;
+					}
+					if (taken > 1) { // Now stealable from the thief
+						etor_->wake_sleeper(thief.index_);
+					}
+				}
+				return taken;
 			}
 			void notify_work() {
 				{
@@ -324,6 +683,9 @@ namespace hungbiu
 				}
 				cv_.notify_one();
 			}
+			bool is_sleeping() const noexcept {
+				return sleeping_.load(std::memory_order_seq_cst);
+			}
 			worker_handle get_handle() noexcept
 			{
 				return worker_handle{ this };
@@ -331,21 +693,13 @@ namespace hungbiu
 		};
 
 		// Worker thread's main function
-		static auto get_thread_affinity_mask(unsigned index) {
-			// Allow the thread to run on 2 logical processors to create scheduling slack
-			// Actually this targets hyperthreading
-			const unsigned core_count = std::thread::hardware_concurrency();
-			auto my_mask = 1 << (index % core_count);
-			return my_mask;
-		}
 		static void thread_main(std::stop_token stoken, hb_executor* this_, std::size_t init_idx)
 		{
-			// Pin thread to processor
-#ifdef _MSC_VER
-			if (!SetThreadAffinityMask(GetCurrentThread(), get_thread_affinity_mask(init_idx))) {
-				throw std::exception{ "failed to set thread affinity!" };
+			// Pin thread to processor, best effort: a restricted cpuset just leaves it floating
+			const int cpu = this_->worker_cpus_[init_idx];
+			if (cpu >= 0) {
+				cpu_topology::pin_current_thread(static_cast<unsigned>(cpu));
 			}
-#endif
 			this_->workers_[init_idx].operator()(stoken);
 		}
 		
@@ -354,13 +708,13 @@ namespace hungbiu
 		// --------------------------------------------------------------------------------
 		mutable std::atomic<bool> is_done_{ false };
 		std::atomic<size_t> ticket_{ 0 };
-		std::vector<worker> workers_;
+		alignas(64) std::atomic<size_t> sleeper_count_{ 0 };
+		std::vector<worker> workers_; // [0, thread_count_): own threads, then guest slots
+		std::vector<int> worker_cpus_; // -1: not pinned
+		size_t thread_count_ = 0;
+		std::unique_ptr<std::atomic<bool>[]> guest_taken_;
 		std::vector<std::jthread> threads_;
 
-#ifdef COUNT_STEALING
-		alignas(64) std::atomic<size_t> steal_count_ { 0 };
-#endif
-
 	public:
 		bool done() noexcept
 		{
@@ -370,17 +724,44 @@ namespace hungbiu
 
 			bool done = false;
 			is_done_.compare_exchange_strong(done, true, std::memory_order_acq_rel);
+			for (auto& w : workers_) { // Wake parked workers so they can exit
+				w.notify_work();
+			}
 			return is_done();
 		}
 		bool is_done() const noexcept
 		{
 			return is_done_.load(std::memory_order_acquire);
 		}
+		size_t size() const noexcept
+		{
+			return thread_count_;
+		}
+		// Logical CPU worker `idx` is pinned to, -1 if it floats
+		int worker_cpu(size_t idx) const noexcept
+		{
+			return worker_cpus_[idx];
+		}
 #ifdef COUNT_STEALING
 		size_t get_steal_count() const noexcept {
-			return steal_count_.load(std::memory_order_acquire);
+			return get_steal_stats().steals;
+		}
+		// Summed over workers, for the policy this executor runs with
+		steal_stats_t get_steal_stats() const noexcept {
+			steal_stats_t stats;
+			for (const auto& w : workers_) {
+				stats.attempts += w.counters_.attempts.load(std::memory_order_relaxed);
+				stats.steals += w.counters_.steals.load(std::memory_order_relaxed);
+				stats.tasks += w.counters_.tasks.load(std::memory_order_relaxed);
+				stats.remote += w.counters_.remote.load(std::memory_order_relaxed);
+			}
+			return stats;
 		}
 #endif
+		steal_policy get_steal_policy() const noexcept
+		{
+			return policy_;
+		}
 	private:
 		// not thread-safe (single producer, multi consumers)
 		std::size_t random_idx(rng_t* rng) noexcept
@@ -396,34 +777,141 @@ namespace hungbiu
 		void dispatch(task_wrapper tw)
 		{
 			auto idx = ticket_.load();
-			const auto sz = workers_.size();
+			const auto sz = thread_count_; // Guests may leave any time
 			workers_[idx % sz].assign(tw);
 			workers_[idx % sz].notify_work();
 			ticket_.compare_exchange_strong(idx, idx + 1, std::memory_order_acq_rel);
 		} 
 		const bool enable_stealing_;
+		// Called after `pusher` made a task stealable
+		void wake_sleeper(const std::size_t pusher)
+		{
+			if (!enable_stealing_) {
+				return; // Parked workers could not take it anyway
+			}
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (0 == sleeper_count_.load(std::memory_order_seq_cst)) {
+				return;
+			}
+			for (size_t i = pusher + 1; i < pusher + workers_.size(); ++i) {
+				auto& w = workers_[i % workers_.size()];
+				if (w.is_sleeping()) {
+					w.notify_work();
+					return;
+				}
+			}
+		}
+		const steal_policy policy_;
+		const bool steal_half_;
 		[[nodiscard]] bool steal(task_wrapper& tw, const std::size_t idx, rng_t* rng)
 		{		
-			for (size_t i = idx + 1; i < idx + workers_.size(); ++i) {
-				if (workers_[i % workers_.size()].try_steal(tw)) {
-
+			auto& thief = workers_[idx];
+			auto probe = [&](const std::size_t victim) -> bool {
+				const std::size_t taken = workers_[victim].try_steal(tw, thief, steal_half_);
 #ifdef COUNT_STEALING
-				steal_count_.fetch_add(1, std::memory_order_relaxed);
+				thief.counters_.attempts.fetch_add(1, std::memory_order_relaxed);
+				if (taken) {
+					thief.counters_.steals.fetch_add(1, std::memory_order_relaxed);
+					thief.counters_.tasks.fetch_add(taken, std::memory_order_relaxed);
+					if (distance(idx, victim) > 1) {
+						thief.counters_.remote.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
 #endif
-					return true;
+				if (taken) {
+					thief.last_victim_ = victim;
+				}
+				return taken;
+			};
+
+			const auto& victims = thief.victims_;
+			if (steal_policy::linear == policy_) {
+				for (auto v : victims) {
+					if (probe(v)) return true;
 				}
+				return false;
+			}
+			if (steal_policy::last_victim == policy_ && thief.last_victim_ < workers_.size()) {
+				if (probe(thief.last_victim_)) return true;
+			}
+
+			// Every level in turn, from a random start inside it
+			std::size_t first = 0;
+			for (auto last : thief.victim_levels_) {
+				const std::size_t n = last - first;
+				const std::size_t start = random_idx(rng) % n;
+				for (std::size_t k = 0; k < n; ++k) {
+					if (probe(victims[first + (start + k) % n])) return true;
+				}
+				first = last;
 			}
 			return false;
 		}		
+
+		// 0: SMT sibling, 1: same package, 2: same NUMA node, 3: farther or unknown
+		unsigned distance(const std::size_t a, const std::size_t b) const noexcept
+		{
+			const auto& topology = cpu_topology::get();
+			const int ca = worker_cpus_[a], cb = worker_cpus_[b];
+			const logical_cpu* pa = ca < 0 ? nullptr : topology.find(static_cast<unsigned>(ca));
+			const logical_cpu* pb = cb < 0 ? nullptr : topology.find(static_cast<unsigned>(cb));
+			if (!pa || !pb) return 3;
+			if (pa->package == pb->package) {
+				return pa->core == pb->core ? 0 : 1;
+			}
+			return pa->node == pb->node ? 2 : 3;
+		}
+
+		// Victim order of every worker, see steal_policy
+		void build_victims()
+		{
+			const std::size_t n = workers_.size();
+			for (std::size_t i = 0; i < n; ++i) {
+				auto& w = workers_[i];
+				w.victims_.clear();
+				w.victim_levels_.clear();
+				for (std::size_t k = 1; k < n; ++k) {
+					w.victims_.push_back((i + k) % n);
+				}
+				if (steal_policy::hierarchical == policy_) {
+					std::stable_sort(w.victims_.begin(), w.victims_.end(), [&](std::size_t a, std::size_t b) {
+						return distance(i, a) < distance(i, b);
+					});
+					for (std::size_t k = 0; k < w.victims_.size(); ++k) {
+						const bool level_ends = k + 1 == w.victims_.size()
+							|| distance(i, w.victims_[k]) != distance(i, w.victims_[k + 1]);
+						if (level_ends) {
+							w.victim_levels_.push_back(k + 1);
+						}
+					}
+				}
+				else if (!w.victims_.empty()) {
+					w.victim_levels_.push_back(w.victims_.size());
+				}
+			}
+		}
 			
 	public:				
-		hb_executor(size_t parallelism, bool enable_stelaing = true) :
-			enable_stealing_(enable_stelaing)
+		hb_executor(size_t parallelism, bool enable_stelaing = true, const placement_t& placement = {}) :
+			hb_executor(parallelism, executor_options_t{ enable_stelaing, placement }) {}
+		hb_executor(size_t parallelism, const executor_options_t& options) :
+			enable_stealing_(options.enable_stealing),
+			policy_(options.policy),
+			steal_half_(options.steal_half)
 		{
-			workers_.reserve(parallelism);
+			const auto& topology = cpu_topology::get();
+			const size_t worker_count = parallelism + options.guest_slots;
+			thread_count_ = parallelism;
+			workers_.reserve(worker_count);
+			worker_cpus_.reserve(worker_count);
 			threads_.reserve(parallelism);
-			for (auto i = 0u; i < parallelism; ++i) {
+			for (auto i = 0u; i < worker_count; ++i) {
 				workers_.emplace_back(*this, i);
+				worker_cpus_.push_back(i < parallelism ? topology.cpu_for(options.placement, i) : -1);
+			}
+			guest_taken_ = std::make_unique<std::atomic<bool>[]>(options.guest_slots);
+			build_victims();
+			for (auto i = 0u; i < parallelism; ++i) {
 				threads_.emplace_back(thread_main, this, i);
 			}
 		}
@@ -432,7 +920,11 @@ namespace hungbiu
 			done();
 			for (auto& t : threads_) {
 				t.request_stop();
-			}			
+			}
+			threads_.clear(); // Join
+			for (auto& w : workers_) {
+				w.drain();
+			}
 		}
 
 		hb_executor(const hb_executor&) = delete;
@@ -445,10 +937,9 @@ namespace hungbiu
 			if (is_done()) {
 				return future_t<R>{};
 			}
-			auto t = make_task<F, R>(std::forward<F>(func));
-			auto fut = t.get_future();
-			dispatch( std::move(t) );
-			return fut;
+			auto state = future_state<R>::make();
+			dispatch( make_task<F, R>(std::forward<F>(func), state) );
+			return future_t<R>{ state };
 		}
 		
 		// Submit a task to current thread and doesn't return result
@@ -459,6 +950,55 @@ namespace hungbiu
 			if (is_done()) { return; }
 			dispatch( std::forward<F>(func) );
 		}
+
+		// Let the calling thread, which must not be a worker, join the pool in
+		// a guest slot and run or steal tasks until `done()` holds. Tasks it
+		// forked and did not run go back to the pool when it leaves.
+		// Returns false at once if every guest slot is taken
+		template <typename Pred>
+		requires std::predicate<Pred&>
+		bool help_until(Pred done)
+		{
+			const size_t guest_count = workers_.size() - thread_count_;
+			size_t slot = 0;
+			for (; slot < guest_count; ++slot) {
+				if (!guest_taken_[slot].exchange(true, std::memory_order_acquire)) {
+					break;
+				}
+			}
+			if (slot == guest_count) {
+				return false;
+			}
+
+			worker& guest = workers_[thread_count_ + slot];
+			auto h = guest.get_handle();
+			unsigned idle_rounds = 0;
+			while (!done()) {
+				task_wrapper tw;
+				if (guest._pop(tw) || (enable_stealing_ && guest._steal(tw))) {
+					idle_rounds = 0;
+					tw.run(h);
+					continue;
+				}
+				// Guests do not park, back off instead
+				if (++idle_rounds < guest_spin_rounds) {
+					std::this_thread::yield();
+				}
+				else {
+					std::this_thread::sleep_for(std::chrono::microseconds{ 50 });
+				}
+			}
+
+			// Hand leftovers to the pool's own threads
+			task_wrapper tw;
+			while (guest._pop(tw)) {
+				dispatch(std::move(tw));
+			}
+			guest_taken_[slot].store(false, std::memory_order_release);
+			return true;
+		}
+	private:
+		static constexpr unsigned guest_spin_rounds = 64;
 	};
 
 	template <typename F>
@@ -0,0 +1,109 @@
+/*
+* Fixed-dimension payload for publication buffers
+* A position of `Extent` doubles kept inline, or of a dimension fixed once by
+* resize() in one 64-byte aligned block. Publishing into it is one memcpy:
+* no size bookkeeping, no reallocation.
+*/
+#ifndef _INLINE_PAYLOAD
+#define _INLINE_PAYLOAD
+#include <array>
+#include <memory>
+#include <new>
+#include <span>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+namespace hungbiu {
+	template <std::size_t Extent = std::dynamic_extent>
+	class inline_payload {
+		alignas(64) std::array<double, Extent> values_ = {};
+	public:
+		static constexpr std::size_t size() noexcept { return Extent; }
+		void resize(std::size_t dim) {
+			if (dim != Extent) {
+				throw std::length_error("dimension differs from the payload extent");
+			}
+		}
+
+		double* data() noexcept { return values_.data(); }
+		const double* data() const noexcept { return values_.data(); }
+		const double* begin() const noexcept { return data(); }
+		const double* end() const noexcept { return data() + Extent; }
+
+		// A contiguous range of exactly Extent doubles
+		template <typename R>
+		requires (!std::is_same_v<std::remove_cvref_t<R>, inline_payload>)
+		inline_payload& operator=(const R& src) {
+			if (std::size(src) != Extent) {
+				throw std::length_error("payload dimension mismatch");
+			}
+			std::memcpy(data(), std::data(src), Extent * sizeof(double));
+			return *this;
+		}
+	};
+
+	template <>
+	class inline_payload<std::dynamic_extent> {
+		struct aligned_deleter {
+			void operator()(double* p) const noexcept {
+				::operator delete[](p, std::align_val_t{ 64 });
+			}
+		};
+		std::unique_ptr<double[], aligned_deleter> values_;
+		std::size_t size_ = 0;
+
+	public:
+		inline_payload() = default;
+		inline_payload(const inline_payload& oth) { *this = oth; }
+		inline_payload(inline_payload&&) noexcept = default;
+		inline_payload& operator=(inline_payload&&) noexcept = default;
+		inline_payload& operator=(const inline_payload& rhs) {
+			if (this != &rhs) {
+				assign(rhs.data(), rhs.size());
+			}
+			return *this;
+		}
+
+		// Allocate once; later calls must keep the dimension
+		void resize(std::size_t dim) {
+			if (values_ && dim == size_) {
+				return;
+			}
+			if (values_) {
+				throw std::length_error("payload dimension is fixed");
+			}
+			values_.reset(static_cast<double*>(
+				::operator new[](dim * sizeof(double), std::align_val_t{ 64 })));
+			std::memset(values_.get(), 0, dim * sizeof(double));
+			size_ = dim;
+		}
+
+		std::size_t size() const noexcept { return size_; }
+		double* data() noexcept { return values_.get(); }
+		const double* data() const noexcept { return values_.get(); }
+		const double* begin() const noexcept { return data(); }
+		const double* end() const noexcept { return data() + size_; }
+
+		template <typename R>
+		requires (!std::is_same_v<std::remove_cvref_t<R>, inline_payload>)
+		inline_payload& operator=(const R& src) {
+			assign(std::data(src), std::size(src));
+			return *this;
+		}
+
+	private:
+		void assign(const double* src, std::size_t n) {
+			if (0 == n && !values_) {
+				return; // Copy of an unsized payload
+			}
+			resize(n); // No-op once sized
+			if (n) {
+				std::memcpy(data(), src, n * sizeof(double));
+			}
+		}
+	};
+}
+#endif
@@ -0,0 +1,252 @@
+/*
+* Many jobs on one hb_executor
+* A job queues its tasks; the scheduler hands at most `slots` of them to the
+* executor at a time, to the job of highest priority, then to the one that
+* has been granted the fewest slots per unit of weight (fair share). A task
+* gives its slot back when it returns, so the continuations of a long job are
+* rescheduled against the others at every task boundary.
+* Tasks of a cancelled or expired job are dropped without running.
+*/
+#ifndef _JOB_SCHEDULER
+#define _JOB_SCHEDULER
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "executor.h"
+
+namespace hungbiu
+{
+	class job_scheduler;
+
+	class job : public std::enable_shared_from_this<job>
+	{
+		friend class job_scheduler;
+	public:
+		using clock = std::chrono::steady_clock;
+		using worker_handle = hb_executor::worker_handle;
+
+	private:
+		job_scheduler* scheduler_;
+		const int priority_;
+		const double weight_;
+		const clock::time_point deadline_;
+		std::atomic<bool> cancelled_{ false };
+
+		// Guarded by the scheduler's mutex
+		std::deque<hb_executor::task_t> pending_;
+		std::size_t reserved_ = 0; // Granted tasks still in `pending_`
+		std::size_t running_ = 0;  // Slots held
+		double vtime_ = 0.;        // Slots granted / weight
+		bool active_ = false;      // In the scheduler's list
+
+		bool idle() const noexcept
+		{
+			return pending_.empty() && 0 == running_;
+		}
+
+	public:
+		job(job_scheduler& scheduler, int priority, double weight, clock::time_point deadline) noexcept :
+			scheduler_(&scheduler), priority_(priority), weight_(weight), deadline_(deadline) {}
+		job(const job&) = delete;
+		job& operator=(const job&) = delete;
+
+		int priority() const noexcept
+		{
+			return priority_;
+		}
+		bool cancelled() const noexcept
+		{
+			return cancelled_.load(std::memory_order_acquire);
+		}
+		// Cancelled or past the deadline, tasks of this job should stop forking
+		bool should_stop() const noexcept
+		{
+			return cancelled()
+				|| (clock::time_point::max() != deadline_ && clock::now() >= deadline_);
+		}
+
+		// Drop the queued tasks; those already running finish
+		void cancel();
+
+		// Queue a task, from any thread
+		template <typename F>
+		requires is_hb_task<F>
+		void submit(F&& func);
+
+		// Queue a task from a task of the executor, it is pushed onto the
+		// current worker if it gets a slot at once
+		template <typename F>
+		requires is_hb_task<F>
+		void submit(worker_handle& wh, F&& func);
+	};
+
+	class job_scheduler
+	{
+		friend class job;
+		using worker_handle = hb_executor::worker_handle;
+		using task_t = hb_executor::task_t;
+
+		hb_executor& etor_;
+		std::mutex mtx_;
+		std::size_t free_slots_;
+		double vclock_ = 0.; // vtime of the latest grant, where new jobs start
+		std::vector<std::shared_ptr<job>> active_; // Jobs with queued or running tasks
+
+		void enqueue(job& j, task_t tw)
+		{
+			std::lock_guard lk{ mtx_ };
+			j.pending_.push_back(std::move(tw));
+			if (!j.active_) {
+				j.active_ = true;
+				j.vtime_ = std::max(j.vtime_, vclock_); // No credit for idle time
+				active_.push_back(j.shared_from_this());
+			}
+		}
+
+		// Locked. Queued tasks nobody was granted go to `dropped`
+		static void drop_unreserved(job& j, std::deque<task_t>& dropped)
+		{
+			while (j.pending_.size() > j.reserved_) {
+				dropped.push_back(std::move(j.pending_.back()));
+				j.pending_.pop_back();
+			}
+		}
+
+		// Locked. Job to grant the next slot to, forgets idle jobs
+		job* pick(std::deque<task_t>& dropped)
+		{
+			job* best = nullptr;
+			for (auto it = active_.begin(); it != active_.end(); ) {
+				job& j = **it;
+				if (j.pending_.size() > j.reserved_ && j.should_stop()) {
+					drop_unreserved(j, dropped);
+				}
+				if (j.idle()) {
+					j.active_ = false;
+					it = active_.erase(it);
+					continue;
+				}
+				const bool waiting = j.pending_.size() > j.reserved_;
+				if (waiting && (!best
+					|| j.priority_ > best->priority_
+					|| (j.priority_ == best->priority_ && j.vtime_ < best->vtime_))) {
+					best = &j;
+				}
+				++it;
+			}
+			return best;
+		}
+
+		// Grant free slots; `wh` is null outside the executor
+		void pump(worker_handle* wh)
+		{
+			std::deque<task_t> dropped; // Destroyed after unlocking
+			for (;;) {
+				job* next = nullptr;
+				{
+					std::lock_guard lk{ mtx_ };
+					if (0 == free_slots_) {
+						break;
+					}
+					next = pick(dropped);
+					if (!next) {
+						break;
+					}
+					--free_slots_;
+					++next->reserved_;
+					++next->running_;
+					vclock_ = std::max(vclock_, next->vtime_);
+					next->vtime_ += 1. / next->weight_;
+				}
+				// The job stays listed while it holds the slot
+				auto granted = [next](worker_handle& h) {
+					next->scheduler_->run_granted(*next, h);
+				};
+				if (wh) {
+					wh->execute(std::move(granted));
+				}
+				else {
+					etor_.execute(std::move(granted));
+				}
+			}
+		}
+
+		// Runs the oldest queued task of `j` in the slot it was granted
+		void run_granted(job& j, worker_handle& wh)
+		{
+			{
+				task_t tw;
+				{
+					std::lock_guard lk{ mtx_ };
+					--j.reserved_;
+					tw = std::move(j.pending_.front());
+					j.pending_.pop_front();
+				}
+				if (!j.should_stop()) {
+					tw.run(wh);
+				}
+			}
+			{
+				std::lock_guard lk{ mtx_ };
+				--j.running_;
+				++free_slots_;
+			}
+			pump(&wh);
+		}
+
+		void drop(job& j)
+		{
+			std::deque<task_t> dropped;
+			std::lock_guard lk{ mtx_ };
+			drop_unreserved(j, dropped);
+		}
+
+	public:
+		using clock = job::clock;
+
+		// `slots`: tasks of all jobs running at once
+		explicit job_scheduler(hb_executor& etor) :
+			job_scheduler(etor, etor.size()) {}
+		job_scheduler(hb_executor& etor, std::size_t slots) :
+			etor_(etor), free_slots_(std::max<std::size_t>(1, slots)) {}
+		job_scheduler(const job_scheduler&) = delete;
+		job_scheduler& operator=(const job_scheduler&) = delete;
+		~job_scheduler() = default; // Must outlive the tasks it granted
+
+		// `weight`: share of the slots against jobs of the same priority
+		std::shared_ptr<job> make_job(int priority = 0, double weight = 1.
+			, clock::time_point deadline = clock::time_point::max())
+		{
+			return std::make_shared<job>(*this, priority, weight, deadline);
+		}
+	};
+
+	inline void job::cancel()
+	{
+		cancelled_.store(true, std::memory_order_release);
+		scheduler_->drop(*this);
+	}
+
+	template <typename F>
+	requires is_hb_task<F>
+	void job::submit(F&& func)
+	{
+		scheduler_->enqueue(*this, hb_executor::task_t{ std::forward<F>(func) });
+		scheduler_->pump(nullptr);
+	}
+
+	template <typename F>
+	requires is_hb_task<F>
+	void job::submit(worker_handle& wh, F&& func)
+	{
+		scheduler_->enqueue(*this, hb_executor::task_t{ std::forward<F>(func) });
+		scheduler_->pump(&wh);
+	}
+} // end namespace hungbiu
+
+#endif // _JOB_SCHEDULER
@@ -2,13 +2,14 @@
 #define COUNT_STEALING
 //#define PAPSO2_TRACK_CONVERGENCY
 #include "papso2_test.h"
+#include "sequential_pso.h"
 #include <cstdio>
 #include<string>
 #include<omp.h>
 template <size_t Scale> requires (Scale > 0)
 struct scaled_rosenbrock {
 	static double function(iter beg, iter end) {
-		static constexpr auto rosenbrock = test_functions::functions[2];
+		static constexpr auto rosenbrock = test_functions::simd_functions[2];
 		volatile double result = 0;
 		//omp_set_num_threads(12);
 #pragma //omp parallel for
@@ -26,9 +27,56 @@ struct scaled_rosenbrock {
 	};
 };
 
+// Self checks of papso2_test.h, nonzero exit on failure
+static int run_checks() {
+	hungbiu::hb_executor etor(8);
+	bool ok = true;
+	ok = check_test_functions_accuracy() && ok;
+	ok = check_update_kernels() && ok;
+	ok = check_partition<papso>(etor) && ok;
+	ok = check_batch_problem<papso>(etor) && ok;
+	ok = check_auto_fork_count<papso>() && ok;
+	ok = check_numa_local<papso>(etor) && ok;
+	ok = check_deterministic_fork_count<papso>() && ok;
+	ok = check_seqlock_buffer<papso>() && ok;
+	ok = check_soa_storage<hungbiu::spmc_buffer<hungbiu::inline_payload<>>>(etor) && ok;
+	ok = check_future_no_state() && ok;
+	ok = check_steal_policies() && ok;
+	ok = check_cancelled_before_start<papso>(etor) && ok;
+	ok = check_cancelled_publication<papso>(etor) && ok;
+	etor.done();
+	std::printf(ok ? "checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
+
+// Anytime reports of the test functions, the default engine with autotuned
+// subswarms then the sequential baseline
+static int run_anytime(std::size_t repetitions, std::size_t thread_count) {
+	hungbiu::hb_executor etor(thread_count);
+	std::printf("papso, %zu threads\n", thread_count);
+	anytime_benchmark_suite<papso>(etor, 0, 0, repetitions);
+	std::printf("sequential_pso\n");
+	anytime_benchmark_suite<sequential_pso>(etor, 1, 0, repetitions);
+	etor.done();
+	return 0;
+}
+
 int main(int argc, const char* argv[]) {
+	if (argc > 1 && std::string{ argv[1] } == "--check") {
+		return run_checks();
+	}
+	if (argc > 1 && std::string{ argv[1] } == "--anytime") {
+		const size_t repetitions = argc > 2 ? std::stoul(std::string{ argv[2] }) : 15;
+		const size_t threads = argc > 3
+			? std::stoul(std::string{ argv[3] })
+			: std::max(1u, std::thread::hardware_concurrency());
+		return run_anytime(repetitions, threads);
+	}
 	if (argc <= 2) {
-		std::printf("Usage: papso [number of subswarms] [iterations/task] [thread_count(optional)]\n");
+		std::printf("Usage: papso [number of subswarms] [iterations/task] [thread_count(optional)]\n"
+			"       0 subswarms or iterations/task: autotune\n"
+			"       papso --check: self checks\n"
+			"       papso --anytime [repetitions] [thread_count]: anytime reports of papso and sequential_pso\n");
 		return -1;
 	}
 
@@ -36,7 +84,7 @@ int main(int argc, const char* argv[]) {
 	size_t iter_per_task = std::stoul(std::string{ argv[2] });
 
 	size_t thread_count = argc < 4
-		? fork_count
+		? (fork_count ? fork_count : std::max(1u, std::thread::hardware_concurrency()))
 		: std::stoul(std::string{ argv[3] });
 
 	hungbiu::hb_executor etor(thread_count);
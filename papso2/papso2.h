@@ -11,22 +11,31 @@
 #include <mutex>
 #include <condition_variable>
 #include <future>
+#include <random>
+#include <cstdint>
+#include <span>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <cmath>
+#include <bit>
+#include <functional>
 #include "executor.h"
+#include "job_scheduler.h"
 #include "spmc_buffer.h"
+#include "seqlock_buffer.h"
+#include "inline_payload.h"
 #include "canonical_rng.h"
+#include "swarm_storage.h"
+#include "update_kernel.h"
+#include "pso_common.h"
 
-using vec_t = std::vector<double>;
-using iter = vec_t::const_iterator;
-using func_t = double(*)(iter, iter);
-using bound_t = std::pair<double, double>;
-
-struct optimization_problem_t {
-	const func_t function;
-	bound_t feasible_bound;
-	size_t dimension;
-};
-
-template <typename buffer_t, size_t neighbor_size, size_t swarm_size, size_t iteration>
+// neighbor_size, swarm_size and iteration are defaults, see papso_options_t
+template <typename buffer_t, size_t default_neighbor_size, size_t default_swarm_size, size_t default_iteration,
+	typename storage_t = aos_swarm_storage>
 class basic_papso {
 	class alignas(64) aligned_atomic_double {
 		std::atomic<double> value_;
@@ -45,52 +54,134 @@ class basic_papso {
 		}
 	};
 
-	// particle
-	struct my_particle {
-		double value;
-		double best_value;
-		vec_t velocity;
-		vec_t position;
-		vec_t best_position;
+	// Best published pbest: the value in an order-preserving encoding with its
+	// low bits replaced by the particle index, so one CAS-min keeps both
+	// together. Values equal but for those bits go to the lower index
+	class alignas(64) gbest_register {
+		static constexpr std::uint64_t empty = ~std::uint64_t{ 0 };
+		std::atomic<std::uint64_t> key_{ empty };
+		std::uint64_t index_mask_ = 0;
+
+		static std::uint64_t encode(double value) noexcept {
+			const auto bits = std::bit_cast<std::uint64_t>(value);
+			return (bits >> 63) ? ~bits : bits | (std::uint64_t{ 1 } << 63);
+		}
+	public:
+		void reset(std::size_t particle_count) noexcept {
+			index_mask_ = (std::uint64_t{ 1 } << std::bit_width(particle_count)) - 1;
+			key_.store(empty, std::memory_order_relaxed);
+		}
+		// After particle i published `value`
+		void offer(double value, std::size_t i) noexcept {
+			const std::uint64_t key = (encode(value) & ~index_mask_) | i;
+			std::uint64_t current = key_.load(std::memory_order_relaxed);
+			while (key < current
+				&& !key_.compare_exchange_weak(current, key, std::memory_order_release, std::memory_order_relaxed)) {}
+		}
+		bool has_value() const noexcept {
+			return empty != key_.load(std::memory_order_acquire);
+		}
+		std::size_t index() const noexcept {
+			return static_cast<std::size_t>(key_.load(std::memory_order_acquire) & index_mask_);
+		}
 	};
+
 public:
 
-	using particle = my_particle;
 	using atomic_double = aligned_atomic_double;
 	using size_t = std::size_t;
 	using range_t = std::pair<size_t, size_t>;
 	using worker_handle = hungbiu::hb_executor::worker_handle;
 
-	static constexpr size_t swarm_size = swarm_size;
-
 private:
 
 	const func_t f;
+	const batch_func_t batch_f = nullptr; // Evaluate whole subswarms when present
 	size_t dimension;
 	double min, max;
-	size_t iteration_per_task;
-	std::atomic<particle*> gbest = { nullptr };
-	std::vector<particle> particles;
+	std::atomic<size_t> iteration_per_task; // Changes once when autotuning
+	size_t swarm_size = default_swarm_size;
+	size_t neighbor_size = default_neighbor_size;
+	size_t iteration = default_iteration;
+	std::uint64_t seed = 0;
+	papso_options_t::publication_t publication = papso_options_t::publication_t::immediate;
+	std::shared_ptr<hungbiu::job> job;
+	stop_rules_t rules;
+	const update_kernel::kernel_type move_kernel = update_kernel::get();
+	gbest_register gbest;
+	storage_t swarm;
 		
 	//--------------------------------
 	// Synchronization
 	std::vector<atomic_double> best_values;
 	std::vector<buffer_t> best_positions;	
 	std::vector<canonical_rng> rngs;
+	std::vector<unsigned char> unpublished; // Owned by the subswarm of each particle
 	//--------------------------------
 
-	std::mutex completion_mtx;
-	std::condition_variable completion_cv;
-	size_t forks = 0 ;
+	// Deterministic mode: epoch e reads snapshot e % 2 and writes the other
+	static constexpr size_t deterministic_fork_count = 8; // For fork_count 0
+	struct epochs_t {
+		size_t length = 0;                // Iterations between barriers
+		std::vector<range_t> subswarms;
+		struct snapshot_t {
+			std::vector<double> values;
+			std::vector<double> positions; // dimension per particle
+		} snapshots[2];
+		std::atomic<size_t> arrived{ 0 }; // Subswarms at the barrier
+	};
+	std::unique_ptr<epochs_t> epochs; // Null unless deterministic
+
+	// Completion latch: live tasks of the run, get() waits for zero.
+	// `released` is set after the final notify, so the waiter never frees
+	// the state while the last task is still touching `forks`
+	std::atomic<size_t> forks{ 0 };
+	std::atomic<bool> released{ false };
+
+	// Stopping state. A criterion may be overshot by one chunk per subswarm
+	std::atomic<bool> stopped{ false };
+	std::atomic<size_t> evaluations{ 0 };
+	std::atomic<double> best_seen{ std::numeric_limits<double>::max() };
+	std::atomic<size_t> last_improvement{ 0 }; // Iteration that lowered `best_seen`
+
+	// Autotuning of iteration_per_task: the first chunks are timed, then
+	// chunks are made long enough that the fork to start latency of a task
+	// is at most 1 / tuning_overhead_ratio of its work
+	struct tuning_t {
+		size_t probe_tasks = 0;              // Timed before picking
+		std::atomic<size_t> timed{ 0 };
+		std::atomic<double> busy{ 0. };      // Seconds per particle-iteration, summed over tasks
+		std::atomic<double> latency{ 0. };   // Seconds from fork to start, summed over tasks
+		std::atomic<bool> done{ false };
+		std::vector<std::chrono::steady_clock::time_point> forked_at; // Per subswarm, written by its tasks
+	};
+	std::unique_ptr<tuning_t> tuning; // Null unless autotuning
+	static constexpr size_t tuning_probe_chunks = 10;  // Per subswarm
+	static constexpr double tuning_overhead_ratio = 50.;
+	static constexpr size_t tuning_min_chunks = 16;    // Per subswarm, for balance
+
+	bool is_completed() const noexcept {
+		return released.load(std::memory_order_acquire);
+	}
+
+	void wait_for_completion() const noexcept {
+		for (size_t n = forks.load(std::memory_order_acquire); n != 0; n = forks.load(std::memory_order_acquire)) {
+			forks.wait(n, std::memory_order_acquire);
+		}
+		while (!is_completed()) { // The last task is between its decrement and `released`
+			std::this_thread::yield();
+		}
+	}
 
 	class fork_tracer {
 		basic_papso* state_ptr;
 	public:
 		fork_tracer(basic_papso* p) 
 			: state_ptr(p) {
-			std::lock_guard guard{ p->completion_mtx };
-			p->forks++;
-			std::cout << "forks=" << p->forks << std::endl;
+			[[maybe_unused]] const size_t count = p->forks.fetch_add(1, std::memory_order_relaxed) + 1;
+#ifdef PAPSO2_TRACE_FORKS
+			std::printf("forks=%zu\n", count);
+#endif
 		}
 		fork_tracer(fork_tracer&& oth) noexcept
 			: state_ptr(std::exchange(oth.state_ptr, nullptr)) {}
@@ -98,18 +189,9 @@ private:
 			if (!state_ptr) {
 				return;
 			}
-
-			bool is_completed = false;
-			{ // Critical section
-				std::lock_guard guard{ state_ptr->completion_mtx };
-				state_ptr->forks--;
-				if (0 == state_ptr->forks) {
-					is_completed = true;
-				}
-			}
-
-			if (is_completed) {
-				state_ptr->completion_cv.notify_one();
+			if (1 == state_ptr->forks.fetch_sub(1, std::memory_order_acq_rel)) {
+				state_ptr->forks.notify_all();
+				state_ptr->released.store(true, std::memory_order_release);
 			}
 		}
 	};
@@ -119,117 +201,163 @@ public:
 		f(f),
 		dimension(dim), min(bounds.first), max(bounds.second),
 		iteration_per_task(iter_per_task) {}
+	basic_papso(const batch_func_t batch_f, const bound_t& bounds, size_t dim, size_t iter_per_task) :
+		f(nullptr), batch_f(batch_f),
+		dimension(dim), min(bounds.first), max(bounds.second),
+		iteration_per_task(iter_per_task) {}
 	basic_papso(const basic_papso&) = delete;
 
 private:
-	void initialize_state(size_t fork_count) { // Tons of allocations
-		particles.resize(swarm_size);
+	void initialize_state(bool touch = true) {
+		swarm.resize(swarm_size, dimension, touch);
 		best_values.resize(swarm_size);
 		best_positions.resize(swarm_size);
-		rngs.resize(fork_count);
-
-		for (size_t i = 0; i < swarm_size; ++i) {
-			particle& p = particles[i];
-			p.position.resize(dimension);
-			p.best_position.resize(dimension);
-			p.velocity.resize(dimension);
-			evaluate_particle(i);
+		unpublished.resize(swarm_size);
+		for (auto& buffer : best_positions) { // Publication then never allocates
+			if constexpr (requires { buffer.resize(dimension); }) {
+				buffer.resize(dimension);
+			}
 		}
+		gbest.reset(swarm_size);
+	}
+
+	// Position first: a reader that loads the value then the position gets
+	// one at least as good as the value
+	void publish(size_t i) {
+		const double value = swarm.best_value(i);
+		best_positions[i].put(std::span<const double>{ swarm.best_position(i), dimension });
+		best_values[i].store(value);
+		gbest.offer(value, i);
 	}
 	
-	void evaluate_particle(size_t i) noexcept {
+	// One objective call for the whole range if the problem is batched
+	void evaluate_range(const range_t range) noexcept {
+		if (batch_f) {
+			swarm.evaluate_batch(range.first, range.second, batch_f);
+		}
+		else {
+			for (size_t i = range.first; i < range.second; ++i) {
+				swarm.value(i) = swarm.evaluate(i, f);
+			}
+		}
+	}
+
+	void evaluate_particle(size_t i, const range_t range) noexcept {
 		// Evaluate
-		particle& p = particles[i];
-		p.value = f(p.position.cbegin(), p.position.cend());
+		swarm.value(i) = swarm.evaluate(i, f);
+		if (update_pbest(swarm, i)) {
+			on_improved(i, range);
+		}
+	}
 
-		// Update pbest
-		if (p.value < p.best_value) {
-			p.best_value = p.value;
-			p.best_position = p.position;
+	// Whether a particle outside `range` has particle i in its neighborhood
+	bool is_boundary(size_t i, const range_t range) const noexcept {
+		const int max_offset = static_cast<int>(neighbor_size / 2);
+		for (int offset = -max_offset; offset <= max_offset; ++offset) {
+			size_t neighbor = ring_neighbor(i, offset, swarm_size);
+			if (neighbor < range.first || range.second <= neighbor) {
+				return true;
+			}
+		}
+		return false;
+	}
 
-			// Publish
-			best_values[i].store(p.value);
-			best_positions[i].put(p.best_position);
+	// Publish now or leave it to flush_unpublished(), see publication_t
+	void on_improved(size_t i, const range_t range) {
+		using publication_t = papso_options_t::publication_t;
+		const bool now = publication_t::immediate == publication
+			|| (publication_t::boundary == publication && is_boundary(i, range));
+		if (now) {
+			publish(i);
+		}
+		else {
+			unpublished[i] = 1;
 		}
 	}
 
-	void initialize_swarm(canonical_rng& rng) { // Must evaluate particles first!
-		auto random_xi = [&]() {
-			return min + rng() * (max - min);
+	void flush_unpublished(const range_t range) {
+		for (size_t i = range.first; i < range.second; ++i) {
+			if (unpublished[i]) {
+				unpublished[i] = 0;
+				publish(i);
+			}
+		}
+	}
+
+	void initialize_swarm(const range_t range, canonical_rng& rng) { // Must evaluate particles first!
+		// Uses substream 0, iterations start from substream 1
+		vec_t random_block(2 * dimension);
+		double* r = random_block.data();
+		auto random_xi = [&](size_t j) {
+			return min + r[j] * (max - min);
 		};
 
-		for (size_t i = 0; i < swarm_size; ++i) { // particle i
-			particle& p = particles[i];
+		for (size_t i = range.first; i < range.second; ++i) { // particle i
+			double* position = swarm.position(i);
+			double* best_position = swarm.best_position(i);
+			double* velocity = swarm.velocity(i);
+			rng.fill(r, r + 2 * dimension);
 			for (size_t j = 0; j < dimension; ++j) { // dimension j
-				p.position[j] = random_xi();
-				p.best_position[j] = p.position[j];
-				p.velocity[j] = (random_xi() - p.position[j]) / 2.0;
+				position[j] = random_xi(j);
+				best_position[j] = position[j];
+				velocity[j] = (random_xi(dimension + j) - position[j]) / 2.0;
 			}
+		}
 
-			p.best_value = p.value = f(p.position.cbegin(), p.position.cend());
+		evaluate_range(range);
+		for (size_t i = range.first; i < range.second; ++i) {
+			swarm.best_value(i) = swarm.value(i);
 			
 			// Publish
-			best_values[i].store(p.best_value);
-			best_positions[i].put(p.best_position);
+			publish(i);
 		}
 	}	
 	
-	particle& update_gbest() noexcept { // Thread safe!
-		particle* best_ptr = &particles.front();
-		double best_val = best_values.front().load();
-
-		for (size_t i = 0; i < swarm_size; ++i) {
-			double v = best_values[i].load();
-			if (v < best_val) {				
-				best_ptr = &particles[i]; 
-				best_val = v;
-			}
+	// Thread safe! The position is at least as good as the value, see publish()
+	std::tuple<double, vec_t> gbest_snapshot() {
+		if (!gbest.has_value()) { // Not initialized yet
+			return { std::numeric_limits<double>::infinity(), vec_t{} };
 		}
-		gbest.store(best_ptr, std::memory_order_release);
-		return *best_ptr;
+		const size_t i = gbest.index();
+		const double value = best_values[i].load();
+		auto viewer = best_positions[i].get();
+		const double* first = std::data(*viewer);
+		return { value, vec_t(first, first + dimension) };
 	}
 
-	const vec_t& get_lbest_unsafe(int idx) const noexcept {
-		const particle* lbest_ptr = &particles[idx]; // !!Middle of neighbor
-		const int max_offset = neighbor_size / 2; // Always positive
-		// offset: [-max_offset, +max_offset]
-		for (int offset = -max_offset; offset <= max_offset; ++offset) {
-			size_t neighbor = (idx + swarm_size + offset) % swarm_size; // in case (idx + offset) < 0
-			if (particles[neighbor].best_value < lbest_ptr->best_value) {
-				lbest_ptr = &particles[neighbor];
-			}
-		}
-		return lbest_ptr->best_position;
+	const double* get_lbest_unsafe(int idx) const noexcept {
+		return swarm.best_position(lbest_index(idx, neighbor_size, swarm_size, [this](size_t j) {
+			return swarm.best_value(j);
+		}));
 	}
 
-	using var_t = std::variant<const vec_t*, typename buffer_t::viewer>;
-	var_t get_lbest(int idx, const range_t range) noexcept { // Thread safe!
-		size_t lbest_idx = idx;	// !!Middle of neighbor
-		double lbest_val = particles[idx].best_value;
-		const int max_offset = neighbor_size / 2; // Always positive
-
+	// Deterministic mode, neighbors outside `range` as of the last barrier
+	const double* get_lbest(size_t idx, const range_t range, const typename epochs_t::snapshot_t& snapshot) const noexcept {
 		auto in_range = [&](size_t i) -> bool {
 			return range.first <= i && i < range.second;
 		};
+		const size_t lbest_idx = lbest_index(idx, neighbor_size, swarm_size, [&](size_t j) {
+			return in_range(j) ? swarm.best_value(j) : snapshot.values[j];
+		});
+		return in_range(lbest_idx)
+			? swarm.best_position(lbest_idx)
+			: snapshot.positions.data() + lbest_idx * dimension;
+	}
 
-		// Traverse neighborhood
-		// offset: [-max_offset, +max_offset]
-		for (int offset = -max_offset; offset <= max_offset; ++offset) {
-			size_t neighbor = (idx + swarm_size + offset) % swarm_size; // in case (idx + offset) < 0
-
-			double v = in_range(neighbor)
-				? particles[neighbor].best_value
-				: best_values[neighbor].load();		
+	using var_t = std::variant<const double*, typename buffer_t::viewer>;
+	var_t get_lbest(int idx, const range_t range) noexcept { // Thread safe!
+		auto in_range = [&](size_t i) -> bool {
+			return range.first <= i && i < range.second;
+		};
 
-			if (v < lbest_val) {
-				lbest_val = v;
-				lbest_idx = neighbor;
-			}
-		}
+		// Traverse neighborhood, published pbests outside the subswarm
+		const size_t lbest_idx = lbest_index(idx, neighbor_size, swarm_size, [&](size_t j) {
+			return in_range(j) ? swarm.best_value(j) : best_values[j].load();
+		});
 
 		// Return
 		if (in_range(lbest_idx)) {
-			return &particles[lbest_idx].best_position;
+			return swarm.best_position(lbest_idx);
 		}
 		else {			
 			return best_positions[lbest_idx].get();
@@ -237,46 +365,26 @@ private:
 	}
 
 	void move_particle(size_t idx, var_t lbest_var, canonical_rng* rng_ptr) {
-		auto calculate_velocity = [rng_ptr](double vi, double xi, double pbest, double lbest) {
-			static constexpr double INERTIA = 0.7298;
-			static constexpr double ACCELERATOR = 1.49618;
-
-			canonical_rng& rng = *rng_ptr;
-			return INERTIA * vi
-				+ ACCELERATOR * rng() * (pbest - xi)
-				+ ACCELERATOR * rng() * (lbest - xi);
-		};
+		// Random factors of the cognitive and social terms, drawn as one block
+		static thread_local vec_t random_block;
+		random_block.resize(2 * dimension);
+		double* r = random_block.data();
+		rng_ptr->fill(r, r + 2 * dimension);
 
-		particle& p = particles[idx];
-		const vec_t& lbest =
+		const double* lbest =
 			(0 == lbest_var.index())
-			? *std::get<0>(lbest_var) // variant holds `const vec_t*`
-			: *std::get<1>(lbest_var); // variant holds `buffer_t::viewer`
-
-		for (size_t d = 0; d < dimension; ++d) {
-			double& vi = p.velocity[d];
-			double& xi = p.position[d];
-			vi = calculate_velocity(vi, xi, p.best_position[d], lbest[d]);
-			xi += vi;
+			? std::get<0>(lbest_var) // variant holds `const double*`
+			: std::data(*std::get<1>(lbest_var)); // variant holds `buffer_t::viewer`
 
-			// Confinement
-			if (xi < min) {
-				xi = min;
-				vi = 0;
-			}
-			else if (xi > max) {
-				xi = max;
-				vi = 0;
-			}
-			else {
-				// nothing happens
-			}
-		}
+		move_kernel(swarm.velocity(idx), swarm.position(idx)
+			, swarm.best_position(idx), lbest
+			, r, r + dimension
+			, dimension, min, max);
 	}
 
 	range_t make_iteration_range(size_t first) {
 		return { first
-			   , std::min(first + iteration_per_task, iteration) };
+			   , std::min(first + iteration_per_task.load(std::memory_order_relaxed), iteration) };
 	}
 
 	auto fork(const range_t& subswarm_range, const range_t& iteration_range, canonical_rng* rng_ptr) {
@@ -288,36 +396,205 @@ private:
 		};
 	}
 
+	// First task of a subswarm under `numa_local`
+	auto fork_local(const range_t& subswarm_range, const range_t& iteration_range, canonical_rng* rng_ptr) {
+		return[this
+			, tracer = fork_tracer(this)
+			, subswarm_range, iteration_range
+			, rng_ptr] (worker_handle& wh) {
+			swarm.first_touch(subswarm_range.first, subswarm_range.second);
+			initialize_swarm(subswarm_range, *rng_ptr);
+			if (epochs) { // Neighbors may not be initialized yet
+				end_epoch(subswarm_range, { 0, 0 }, wh);
+				return;
+			}
+			pso_main_loop(subswarm_range, iteration_range, rng_ptr, wh);
+		};
+	}
+
+	void take_snapshot(const range_t range, typename epochs_t::snapshot_t& snapshot) noexcept {
+		for (size_t i = range.first; i < range.second; ++i) {
+			snapshot.values[i] = swarm.best_value(i);
+			std::copy_n(swarm.best_position(i), dimension, snapshot.positions.data() + i * dimension);
+		}
+	}
+
+	// Deterministic mode: a subswarm ends the epoch `iteration_range` ({ 0, 0 }
+	// after initializing), the last one to arrive forks the next epoch of all
+	void end_epoch(const range_t subswarm_range, const range_t iteration_range, worker_handle& wh) {
+		auto& e = *epochs;
+		flush_unpublished(subswarm_range); // For gbest and snapshot() only
+		take_snapshot(subswarm_range, e.snapshots[(iteration_range.second / e.length) % 2]);
+		if (e.subswarms.size() != e.arrived.fetch_add(1, std::memory_order_acq_rel) + 1) {
+			return;
+		}
+		e.arrived.store(0, std::memory_order_relaxed); // Nobody arrives before the forks below
+
+		const bool stop = reached_stop({ 0, swarm_size }, iteration_range);
+		if (stop || iteration == iteration_range.second) {
+			return;
+		}
+		const range_t next_iter_range{ iteration_range.second, std::min(iteration_range.second + e.length, iteration) };
+		for (size_t k = 0; k < e.subswarms.size(); ++k) {
+			if (!job) {
+				wh.execute( fork(e.subswarms[k], next_iter_range, &rngs[k]) );
+			}
+			else {
+				job->submit(wh, fork(e.subswarms[k], next_iter_range, &rngs[k]));
+			}
+		}
+	}
+
+	// The task completing the probe picks iteration_per_task
+	void record_timing(const range_t subswarm_range, const range_t iteration_range
+		, std::chrono::steady_clock::time_point started, std::chrono::steady_clock::time_point forked) {
+		using seconds = std::chrono::duration<double>;
+		auto& t = *tuning;
+		const double work = static_cast<double>((subswarm_range.second - subswarm_range.first)
+			* (iteration_range.second - iteration_range.first));
+		t.busy.fetch_add(seconds(std::chrono::steady_clock::now() - started).count() / work, std::memory_order_relaxed);
+		t.latency.fetch_add(seconds(started - forked).count(), std::memory_order_relaxed);
+		if (t.probe_tasks != t.timed.fetch_add(1, std::memory_order_acq_rel) + 1) {
+			return;
+		}
+
+		const double particle_iteration = t.busy.load(std::memory_order_relaxed) / t.probe_tasks;
+		const double overhead = t.latency.load(std::memory_order_relaxed) / t.probe_tasks;
+		const double task_particles = static_cast<double>(swarm_size) / rngs.size();
+		const double longest = static_cast<double>(std::max<size_t>(1, iteration / tuning_min_chunks));
+		const double chunk = particle_iteration > 0.
+			? std::ceil(tuning_overhead_ratio * overhead / (particle_iteration * task_particles))
+			: longest;
+		iteration_per_task.store(static_cast<size_t>(std::clamp(chunk, 1., longest)), std::memory_order_relaxed);
+		t.done.store(true, std::memory_order_relaxed);
+#ifdef PAPSO2_TRACE_TUNING
+		std::printf("tuned: %.3gs per particle-iteration, %.3gs per fork, %zu iterations per task\n"
+			, particle_iteration, overhead, iteration_per_task.load(std::memory_order_relaxed));
+#endif
+	}
+
+	// At the end of a chunk: whether the run stops, see stop_criteria_t
+	bool reached_stop(const range_t subswarm_range, const range_t iteration_range) {
+		if (stopped.load(std::memory_order_relaxed)) {
+			return true;
+		}
+		bool stop = job && job->should_stop();
+
+		size_t evaluated = 0;
+		if (rules.counts_evaluations()) {
+			const size_t count = (subswarm_range.second - subswarm_range.first)
+				* (iteration_range.second - iteration_range.first);
+			evaluated = evaluations.fetch_add(count, std::memory_order_relaxed) + count;
+			stop = stop || rules.out_of_evaluations(evaluated);
+		}
+		if (rules.tracks_best()) {
+			double best = swarm.best_value(subswarm_range.first);
+			for (size_t i = subswarm_range.first + 1; i < subswarm_range.second; ++i) {
+				best = std::min(best, swarm.best_value(i));
+			}
+			double seen = best_seen.load(std::memory_order_relaxed);
+			while (best < seen && !best_seen.compare_exchange_weak(seen, best, std::memory_order_relaxed)) {}
+			if (best < seen) {
+				size_t at = last_improvement.load(std::memory_order_relaxed);
+				while (at < iteration_range.second
+					&& !last_improvement.compare_exchange_weak(at, iteration_range.second, std::memory_order_relaxed)) {}
+				if (rules.progress) {
+					rules.progress(evaluated, best);
+				}
+			}
+			stop = stop
+				|| rules.reached_quality(best, iteration_range.second, last_improvement.load(std::memory_order_relaxed));
+		}
+		stop = stop || rules.out_of_time();
+
+		if (stop) {
+			stopped.store(true, std::memory_order_relaxed);
+		}
+		return stop;
+	}
+
 	void pso_main_loop(range_t subswarm_range, range_t iteration_range, canonical_rng* rng_ptr, worker_handle& wh) {
+		const size_t subswarm = rng_ptr - rngs.data();
+		const bool timed = tuning && !tuning->done.load(std::memory_order_relaxed);
+		const auto started = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+		const auto* snapshot = epochs
+			? &epochs->snapshots[(iteration_range.first / epochs->length) % 2]
+			: nullptr;
+		auto lbest_of = [&](size_t j) -> var_t {
+			if (snapshot) {
+				return get_lbest(j, subswarm_range, *snapshot);
+			}
+			return get_lbest(j, subswarm_range);
+		};
+
 		// Loop
 		for (size_t i = iteration_range.first; i < iteration_range.second; ++i) {
-			for (size_t j = subswarm_range.first; j < subswarm_range.second; ++j) {
-				// Lbest				
-				// const vec_t& lbest = get_lbest_unsafe(j);
-				var_t lbest_var = get_lbest(j, subswarm_range);
+			rng_ptr->seek(static_cast<std::uint32_t>(i + 1));
+			if (batch_f) {
+				// Move the whole subswarm, then evaluate it in one call.
+				// Particles see the pbest of their subswarm as of the last iteration
+				for (size_t j = subswarm_range.first; j < subswarm_range.second; ++j) {
+					move_particle(j, lbest_of(j), rng_ptr);
+				}
+				evaluate_range(subswarm_range);
+				for (size_t j = subswarm_range.first; j < subswarm_range.second; ++j) {
+					if (update_pbest(swarm, j)) {
+						on_improved(j, subswarm_range);
+					}
+				}
+			}
+			else {
+				for (size_t j = subswarm_range.first; j < subswarm_range.second; ++j) {
+					// Lbest				
+					// const vec_t& lbest = get_lbest_unsafe(j);
+					var_t lbest_var = lbest_of(j);
 
-				// Update velocity, position				
-				move_particle(j, std::move(lbest_var), rng_ptr); // Sink
+					// Update velocity, position				
+					move_particle(j, std::move(lbest_var), rng_ptr); // Sink
 
-				evaluate_particle(j);
+					evaluate_particle(j, subswarm_range);
 
-			} // end of particle
+				} // end of particle
+			}
 
 #ifdef PAPSO2_TRACK_CONVERGENCY
 				// Only one subswarm would periodly update, print global best
 				// Here the first subswarm is chosen
 				if (0 == subswarm_range.first 
 				&& (i + 1) % 100 == 0) {
-					auto gbest = update_gbest();
-					printf("%6.4lf ", gbest.best_value);
+					printf("%6.4lf ", best_values[gbest.index()].load());
 				}
 #endif
 		} // end of iteration
+
+		if (timed) {
+			record_timing(subswarm_range, iteration_range, started, tuning->forked_at[subswarm]);
+		}
+		if (epochs) {
+			end_epoch(subswarm_range, iteration_range, wh);
+			return;
+		}
 		
+		const bool stop = reached_stop(subswarm_range, iteration_range);
+		const bool last = stop || iteration == iteration_range.second;
+
+		// Deferred improvements: every chunk, or once at the end of the run
+		if (papso_options_t::publication_t::chunk_end == publication || last) {
+			flush_unpublished(subswarm_range);
+		}
+
 		// Fork next iterations
-		if (iteration_range.second < iteration) {
+		if (!last) {
 			range_t next_iter_range = make_iteration_range(iteration_range.second);
-			wh.execute( fork(subswarm_range, next_iter_range, rng_ptr) );			
+			if (tuning && !tuning->done.load(std::memory_order_relaxed)) {
+				tuning->forked_at[subswarm] = std::chrono::steady_clock::now();
+			}
+			if (!job) {
+				wh.execute( fork(subswarm_range, next_iter_range, rng_ptr) );
+			}
+			else {
+				job->submit(wh, fork(subswarm_range, next_iter_range, rng_ptr));
+			}
 		}
 	}
 
@@ -335,60 +612,223 @@ public:
 			return *this;
 		}
 
-		// Block until finished
+		bool ready() const noexcept {
+			return state_->is_completed();
+		}
+
+		// Best (value, position) published so far, while the run goes on; the
+		// value is +inf and the position empty before initialization
+		std::tuple<double, vec_t> snapshot() const {
+			return state_->gbest_snapshot();
+		}
+
+		// Block until finished; +inf and an empty position if the run was
+		// cancelled before any particle was initialized
 		std::tuple<double, vec_t> get() {
 			auto& state = *state_;
-			auto check_for_completion = [&]() {
-				bool is_completed = (0 == state.forks);
-				return is_completed;
-			};
 
 			// Wait for finish
-			{
-				std::unique_lock lock{ state.completion_mtx };
-				state.completion_cv.wait(lock, check_for_completion);
-			}
+			state.wait_for_completion();
+			return collect();
+		}
 
-			// Get result
-			auto& gbest = state.update_gbest();
-			double best_value = gbest.best_value;
-			vec_t best_position = std::move(gbest.best_position);
+		// Run tasks of `etor` on the calling thread until finished; plain
+		// blocking get() if it can't join (no free guest slot)
+		std::tuple<double, vec_t> get(hungbiu::hb_executor& etor) {
+			auto& state = *state_;
+			etor.help_until([&state]() { return state.is_completed(); });
+			state.wait_for_completion();
+			return collect();
+		}
+
+	private:
+		// One exact scan, the register may rank by truncated values. Particles
+		// never published were not initialized (cancelled under numa_local);
+		// held-back improvements count too, a cancelled job drops the task
+		// that would have flushed them
+		std::tuple<double, vec_t> collect() {
+			auto& state = *state_;
+			size_t gbest = state.swarm_size;
+			double gbest_value = std::numeric_limits<double>::max();
+			for (size_t i = 0; i < state.swarm_size; ++i) {
+				const double v = state.unpublished[i]
+					? state.swarm.best_value(i)
+					: state.best_values[i].load();
+				if (v < gbest_value) {
+					gbest = i;
+					gbest_value = v;
+				}
+			}
+			if (state.swarm_size == gbest) {
+				state_.reset();
+				return { std::numeric_limits<double>::infinity(), vec_t{} };
+			}
+			double best_value = state.swarm.best_value(gbest);
+			const double* best_first = state.swarm.best_position(gbest);
+			vec_t best_position(best_first, best_first + state.dimension);
 			state_.reset(); // Release resource
 			return { best_value, std::move(best_position) };
 		}
 	};
 
-	static auto parallel_async_pso(hungbiu::hb_executor& etor, size_t fork_count, size_t iter_per_task, const optimization_problem_t& problem) {
+	// fork_count 0: up to one subswarm per thread of `etor`, fewer if the
+	// objective is too cheap for the fork latency (one per thread under
+	// numa_local, a fixed count if deterministic); at most one per particle, sizes differ by one particle at
+	// most. iter_per_task 0: picked
+	// from the timings of the first iterations (define PAPSO2_TRACE_TUNING to print it)
+	static auto parallel_async_pso(hungbiu::hb_executor& etor, size_t fork_count, size_t iter_per_task, const optimization_problem_t& problem
+		, const papso_options_t& options = {}) {
 		auto pso_state_uptr = std::make_unique<basic_papso>(problem.function, problem.feasible_bound, problem.dimension, iter_per_task);
+		return launch(etor, fork_count, std::move(pso_state_uptr), options);
+	}
+
+	static auto parallel_async_pso(hungbiu::hb_executor& etor, size_t fork_count, size_t iter_per_task, const batch_optimization_problem_t& problem
+		, const papso_options_t& options = {}) {
+		auto pso_state_uptr = std::make_unique<basic_papso>(problem.function, problem.feasible_bound, problem.dimension, iter_per_task);
+		return launch(etor, fork_count, std::move(pso_state_uptr), options);
+	}
+
+private:
+	// Seconds from submitting a task to `etor` to its start, median of a few
+	// probes; 0 if unknown (`etor` is done or too busy to answer soon)
+	static double fork_latency(hungbiu::hb_executor& etor) {
+		using clock = std::chrono::steady_clock;
+		double samples[3] = {};
+		for (auto& sample : samples) {
+			const auto forked = clock::now();
+			auto started = etor.execute_return([](worker_handle&) { return clock::now(); });
+			const auto give_up = forked + std::chrono::milliseconds(10);
+			while (started.valid() && !started.ready() && clock::now() < give_up) {
+				std::this_thread::yield();
+			}
+			if (!started.ready()) {
+				return 0.;
+			}
+			sample = std::chrono::duration<double>(started.get() - forked).count();
+		}
+		std::sort(std::begin(samples), std::end(samples));
+		return samples[1];
+	}
+
+	// fork_count 0: one subswarm per thread, fewer when the longest chunk of a
+	// subswarm (iteration / tuning_min_chunks iterations) could not cover the
+	// fork latency tuning_overhead_ratio times
+	static size_t pick_fork_count(hungbiu::hb_executor& etor, size_t particles, size_t iterations, double particle_seconds) {
+		const size_t most = std::min(particles, std::max<size_t>(1, etor.size()));
+		const double latency = fork_latency(etor);
+		if (!(latency > 0.) || !(particle_seconds > 0.)) {
+			return most;
+		}
+		const double longest = static_cast<double>(std::max<size_t>(1, iterations / tuning_min_chunks));
+		const double affordable = particles * particle_seconds * longest / (tuning_overhead_ratio * latency);
+		const size_t picked = static_cast<size_t>(std::clamp(affordable, 1., static_cast<double>(most)));
+#ifdef PAPSO2_TRACE_TUNING
+		std::printf("tuned: %.3gs per particle, %.3gs per fork, %zu subswarms\n", particle_seconds, latency, picked);
+#endif
+		return picked;
+	}
+
+	// Subswarm i of `count`, sizes differ by one particle at most
+	static range_t subswarm_of(size_t i, size_t count, size_t particles) noexcept {
+		return { i * particles / count, (i + 1) * particles / count };
+	}
+
+	static papso_result_t launch(hungbiu::hb_executor& etor, size_t fork_count, std::unique_ptr<basic_papso> pso_state_uptr
+		, const papso_options_t& options) {
 		auto& state = *pso_state_uptr;
+		apply_shape(options, "papso", state.swarm_size, state.neighbor_size, state.iteration);
+		const size_t swarm_size = state.swarm_size;
+		state.seed = options.seed;
+		state.publication = options.deterministic // Improvements are published at the barriers
+			? papso_options_t::publication_t::chunk_end
+			: options.publication;
+		state.job = options.job;
+		state.rules.set(options);
+		state.evaluations.store(swarm_size, std::memory_order_relaxed);
 
 		using worker_handle = hungbiu::hb_executor::worker_handle;
 
 		// Initialize
-		auto remainder = swarm_size % fork_count;
-		if (remainder) {
-			++fork_count;
+		state.initialize_state(!options.numa_local);
+		if (0 == fork_count && options.deterministic) { // Nothing that varies between runs
+			fork_count = deterministic_fork_count;
+		}
+		if (!options.numa_local) {
+			const auto started = std::chrono::steady_clock::now();
+			canonical_rng rng{ state.seed, 0 }; // Stream of subswarm 0
+			state.initialize_swarm({ 0, swarm_size }, rng);
+			if (0 == fork_count) { // Initialization timed the objective
+				const std::chrono::duration<double> spent = std::chrono::steady_clock::now() - started;
+				fork_count = pick_fork_count(etor, swarm_size, state.iteration, spent.count() / swarm_size);
+			}
+		}
+		if (0 == fork_count) { // Subswarms initialize themselves, one per thread
+			fork_count = std::max<size_t>(1, etor.size());
+		}
+		fork_count = std::min(fork_count, swarm_size); // No empty subswarm
+		state.rngs.reserve(fork_count);
+		for (size_t i = 0; i < fork_count; ++i) {
+			state.rngs.emplace_back(state.seed, i);
+		}
+		if (options.deterministic) {
+			auto& e = *(state.epochs = std::make_unique<epochs_t>());
+			if (0 == state.iteration_per_task.load(std::memory_order_relaxed)) { // Timings would change the barriers
+				state.iteration_per_task.store(std::clamp<size_t>(state.iteration / 250, 1, 20), std::memory_order_relaxed);
+			}
+			e.length = state.iteration_per_task.load(std::memory_order_relaxed);
+			for (auto& snapshot : e.snapshots) {
+				snapshot.values.resize(swarm_size);
+				snapshot.positions.resize(swarm_size * state.dimension);
+			}
+			for (size_t i = 0; i < fork_count; ++i) {
+				e.subswarms.push_back(subswarm_of(i, fork_count, swarm_size));
+			}
+		}
+		if (0 == state.iteration_per_task.load(std::memory_order_relaxed)) {
+			state.tuning = std::make_unique<tuning_t>();
+			state.tuning->probe_tasks = fork_count * tuning_probe_chunks;
+			state.tuning->forked_at.resize(fork_count);
+			state.iteration_per_task.store(std::clamp<size_t>(state.iteration / 250, 1, 20), std::memory_order_relaxed);
+		}
+		if (!options.numa_local) {
+			if (state.epochs) {
+				state.take_snapshot({ 0, swarm_size }, state.epochs->snapshots[0]);
+			}
+			if (state.rules.progress) {
+				state.best_seen.store(state.best_values[state.gbest.index()].load(), std::memory_order_relaxed);
+				state.rules.progress(swarm_size, state.best_seen.load(std::memory_order_relaxed));
+			}
 		}
-		state.initialize_state(fork_count);
-		state.initialize_swarm(state.rngs[0]);
 
 		// Forks
-		size_t fork_size = swarm_size / fork_count;
-		for (size_t i = 0; i < fork_count; ++i) {
-			range_t subswarm_range;
-			subswarm_range.first = fork_size * i;
-			subswarm_range.second = (i + 1)* fork_size;
-			subswarm_range.second = std::min<size_t>(subswarm_range.second, swarm_size);
+		// Keeps the latch open until every fork is submitted
+		fork_tracer launching{ &state };
 
+		for (size_t i = 0; i < fork_count; ++i) {
+			const range_t subswarm_range = subswarm_of(i, fork_count, swarm_size);
 			range_t iter_range = state.make_iteration_range(0);
+			if (state.tuning) {
+				state.tuning->forked_at[i] = std::chrono::steady_clock::now();
+			}
 
-			etor.execute( state.fork(subswarm_range, iter_range, &state.rngs[i]) );
+			if (options.job && options.numa_local) {
+				options.job->submit( state.fork_local(subswarm_range, iter_range, &state.rngs[i]) );
+			}
+			else if (options.job) {
+				options.job->submit( state.fork(subswarm_range, iter_range, &state.rngs[i]) );
+			}
+			else if (options.numa_local) {
+				etor.execute( state.fork_local(subswarm_range, iter_range, &state.rngs[i]) );
+			}
+			else {
+				etor.execute( state.fork(subswarm_range, iter_range, &state.rngs[i]) );
+			}
 		}
 
 		return basic_papso::papso_result_t{ std::move(pso_state_uptr) };
 	}
 };
 
-using papso = basic_papso<hungbiu::spmc_buffer<vec_t>, 2, 40, 5000>;
+using papso = basic_papso<hungbiu::spmc_buffer<hungbiu::inline_payload<>>, 2, 40, 5000>;
 
 #endif
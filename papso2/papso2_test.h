@@ -4,9 +4,44 @@
 #include<chrono>
 #include<string>
 #include<cstring>
+#include<vector>
+#include<mutex>
+#include<memory>
+#include<algorithm>
+#include<cmath>
+#include<limits>
+#include<thread>
+#include<cstdlib>
 #include "papso2.h"
 #include "test_functions.h"
 
+// Cross-check test_functions::simd_functions against the scalar suite,
+// including dimensions that exercise the vector tails.
+// Returns the largest error relative to max(1, |scalar value|) of every function
+inline std::vector<double> test_functions_accuracy_check(std::size_t samples = 1000, std::uint64_t seed = 1) {
+	canonical_rng rng{ seed };
+	std::vector<double> errors;
+	for (std::size_t f = 0; f < test_functions::functions.size(); ++f) {
+		const auto [min, max] = test_functions::bounds[f];
+		const std::size_t dims[] = { 1, 7, test_functions::dimensions[f], 101 };
+		double error = 0;
+		for (auto dim : dims) {
+			std::vector<double> x(dim);
+			for (std::size_t s = 0; s < samples; ++s) {
+				for (auto& xi : x) {
+					xi = min + rng() * (max - min);
+				}
+				const double expected = test_functions::functions[f](x.cbegin(), x.cend());
+				const double actual = test_functions::simd_functions[f](x.cbegin(), x.cend());
+				error = std::max(error, std::abs(actual - expected) / std::max(1., std::abs(expected)));
+			}
+		}
+		std::printf("%s: max error %.3e\n", test_functions::function_names[f], error);
+		errors.push_back(error);
+	}
+	return errors;
+}
+
 template <typename papso_t>
 void parallel_async_pso_benchmark(
 	hungbiu::hb_executor& etor
@@ -21,7 +56,20 @@ void parallel_async_pso_benchmark(
 		auto [v, pos] = result.get(); // Could be wasting?
 		printf_s("\npar async pso @%s: %lf\n", msg, v);
 #ifdef COUNT_STEALING
-		std::printf("steal count: %llu\n", etor.get_steal_count());
+		{
+			const auto stats = etor.get_steal_stats();
+			std::printf("steal count: %llu, attempts: %llu, tasks: %llu, remote: %llu\n"
+				, static_cast<unsigned long long>(stats.steals)
+				, static_cast<unsigned long long>(stats.attempts)
+				, static_cast<unsigned long long>(stats.tasks)
+				, static_cast<unsigned long long>(stats.remote));
+		}
+#endif
+#ifdef COUNT_PENDING_WRITE
+		std::printf("pending writes: %llu, superseded: %llu, flushed by readers: %llu\n"
+			, static_cast<unsigned long long>(hungbiu::pending_write_counters::parked.load())
+			, static_cast<unsigned long long>(hungbiu::pending_write_counters::superseded.load())
+			, static_cast<unsigned long long>(hungbiu::pending_write_counters::flushed.load()));
 #endif
 		auto t2 = std::chrono::high_resolution_clock::now();
 		std::chrono::duration<double> diff = t2 - t1;
@@ -33,4 +81,670 @@ void parallel_async_pso_benchmark(
 	std::cout << "average time:" << avg << std::endl;
 }
 
+// --------------------------------------------------------------------------------
+// Anytime benchmarking
+// A run is a trajectory of its best value so far against wall time and
+// objective evaluations; runs are compared by the time they take to reach
+// given targets, not only by their final values
+// --------------------------------------------------------------------------------
+struct anytime_point {
+	double seconds;
+	std::size_t evaluations;
+	double best;
+};
+
+struct anytime_run {
+	std::vector<anytime_point> trajectory; // Best strictly decreasing
+	double seconds = 0;                     // Until the run finished
+	double final_value = 0;
+};
+
+// Launch `repetitions` runs at once, seeded `seed`, `seed + 1`, ...,
+// and record their trajectories; times count from the launch of each run.
+// The calling thread helps `etor`
+template <typename papso_t, typename problem_t>
+std::vector<anytime_run> record_anytime_runs(
+	hungbiu::hb_executor& etor
+	, std::size_t fork_count
+	, std::size_t iter_per_task
+	, const problem_t& problem
+	, std::size_t repetitions
+	, papso_options_t options = {}
+	, std::uint64_t seed = 1) {
+	using clock = std::chrono::steady_clock;
+	struct recorder {
+		clock::time_point start = clock::now();
+		std::mutex mtx;
+		std::vector<anytime_point> points;
+
+		double since_start() const {
+			return std::chrono::duration<double>(clock::now() - start).count();
+		}
+	};
+
+	std::vector<std::unique_ptr<recorder>> recorders;
+	std::vector<typename papso_t::papso_result_t> results;
+	std::vector<anytime_run> runs(repetitions);
+	recorders.reserve(repetitions);
+	results.reserve(repetitions);
+	for (std::size_t r = 0; r < repetitions; ++r) {
+		recorders.push_back(std::make_unique<recorder>());
+		options.seed = seed + r;
+		options.progress = [rec = recorders.back().get()](std::size_t evaluations, double best) {
+			const double seconds = rec->since_start();
+			std::lock_guard lk{ rec->mtx };
+			rec->points.push_back({ seconds, evaluations, best });
+		};
+		results.push_back(papso_t::parallel_async_pso(etor, fork_count, iter_per_task, problem, options));
+		if (results.back().ready()) { // Engines that run in the call
+			runs[r].seconds = recorders.back()->since_start();
+		}
+	}
+
+	// Collect runs as they finish
+	std::vector<bool> collected(repetitions, false);
+	auto any_ready = [&]() {
+		for (std::size_t r = 0; r < repetitions; ++r) {
+			if (!collected[r] && results[r].ready()) return true;
+		}
+		return false;
+	};
+	for (std::size_t remaining = repetitions; remaining != 0; ) {
+		if (!etor.help_until(any_ready)) {
+			std::this_thread::yield();
+		}
+		for (std::size_t r = 0; r < repetitions; ++r) {
+			if (collected[r] || !results[r].ready()) continue;
+			if (0 == runs[r].seconds) {
+				runs[r].seconds = recorders[r]->since_start();
+			}
+			runs[r].final_value = std::get<0>(results[r].get());
+			collected[r] = true;
+			--remaining;
+		}
+	}
+
+	// Calls may overlap: order by time, keep the improvements
+	for (std::size_t r = 0; r < repetitions; ++r) {
+		auto& points = recorders[r]->points;
+		std::sort(points.begin(), points.end(), [](const anytime_point& a, const anytime_point& b) {
+			return a.seconds < b.seconds;
+		});
+		for (const auto& p : points) {
+			auto& trajectory = runs[r].trajectory;
+			if (trajectory.empty() || p.best < trajectory.back().best) {
+				trajectory.push_back(p);
+			}
+		}
+	}
+	return runs;
+}
+
+// First point of `run` at or below `target`, null if it never got there
+inline const anytime_point* time_to_target(const anytime_run& run, double target) {
+	for (const auto& p : run.trajectory) {
+		if (p.best <= target) return &p;
+	}
+	return nullptr;
+}
+
+// Empirical runtime distribution: seconds (or evaluations) each run took to
+// reach `target`, ascending, +inf for runs that did not. Runs share the
+// executor, so seconds are only comparable at the same repetitions and
+// executor; evaluations are not affected
+inline std::vector<double> runtime_distribution(const std::vector<anytime_run>& runs, double target
+	, bool in_evaluations = false) {
+	std::vector<double> costs;
+	costs.reserve(runs.size());
+	for (const auto& run : runs) {
+		const anytime_point* p = time_to_target(run, target);
+		costs.push_back(!p ? std::numeric_limits<double>::infinity()
+			: in_evaluations ? static_cast<double>(p->evaluations) : p->seconds);
+	}
+	std::sort(costs.begin(), costs.end());
+	return costs;
+}
+
+// Median of an ascending sample with a distribution-free 95% confidence
+// interval from order statistics (normal approximation of the binomial)
+struct median_ci_t {
+	double median, low, high;
+};
+inline median_ci_t median_ci(const std::vector<double>& sorted) {
+	const std::size_t n = sorted.size();
+	if (0 == n) {
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		return { nan, nan, nan };
+	}
+	const double half_width = 0.98 * std::sqrt(static_cast<double>(n)); // 1.96 * sqrt(n) / 2
+	const auto lo = static_cast<std::ptrdiff_t>(std::floor(n / 2. - half_width));
+	const auto hi = static_cast<std::ptrdiff_t>(std::ceil(n / 2. + half_width));
+	const double median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+	return { median
+		, sorted[std::max<std::ptrdiff_t>(lo, 0)]
+		, sorted[std::min<std::ptrdiff_t>(hi, n - 1)] };
+}
+
+// Mean with a 95% confidence interval, normal approximation
+struct mean_ci_t {
+	double mean, half_width;
+};
+inline mean_ci_t mean_ci(const std::vector<double>& sample) {
+	const double n = static_cast<double>(sample.size());
+	double mean = 0;
+	for (double x : sample) mean += x;
+	mean /= n;
+	double variance = 0;
+	for (double x : sample) variance += (x - mean) * (x - mean);
+	variance /= std::max(1., n - 1);
+	return { mean, 1.96 * std::sqrt(variance / n) };
+}
+
+// Print the final quality and, per target, the success rate, the median
+// time-to-target with its confidence interval, the expected running time
+// (time of every run until success or end, over the successes) and the
+// median evaluations to the target. Without targets, the quartiles
+// of the final values are used (from easy to hard)
+inline void anytime_report(const char* const name, const std::vector<anytime_run>& runs
+	, std::vector<double> targets = {}) {
+	std::vector<double> finals;
+	for (const auto& run : runs) finals.push_back(run.final_value);
+	std::sort(finals.begin(), finals.end());
+	const auto quality = mean_ci(finals);
+	const auto median_final = median_ci(finals);
+	std::printf("%s: %zu runs, final best mean %.4e +- %.2e, median %.4e [%.4e, %.4e]\n"
+		, name, runs.size(), quality.mean, quality.half_width
+		, median_final.median, median_final.low, median_final.high);
+
+	if (targets.empty() && !finals.empty()) {
+		for (double q : { 0.75, 0.5, 0.25 }) {
+			targets.push_back(finals[static_cast<std::size_t>(q * (finals.size() - 1))]);
+		}
+	}
+	std::printf("  %12s %8s %26s %10s %28s\n"
+		, "target", "success", "median s [95% CI]", "ERT s", "median evals [95% CI]");
+	for (double target : targets) {
+		const auto seconds = runtime_distribution(runs, target);
+		const auto evaluations = runtime_distribution(runs, target, true);
+		std::size_t successes = 0;
+		double spent = 0;
+		for (std::size_t r = 0; r < runs.size(); ++r) {
+			const anytime_point* p = time_to_target(runs[r], target);
+			successes += p ? 1 : 0;
+			spent += p ? p->seconds : runs[r].seconds;
+		}
+		const auto time = median_ci(seconds);
+		const auto cost = median_ci(evaluations);
+		char time_interval[64], cost_interval[64];
+		std::snprintf(time_interval, sizeof(time_interval), "%.3g [%.3g, %.3g]", time.median, time.low, time.high);
+		std::snprintf(cost_interval, sizeof(cost_interval), "%.3g [%.3g, %.3g]", cost.median, cost.low, cost.high);
+		std::printf("  %12.4e %4zu/%-3zu %26s %10.3g %28s\n"
+			, target, successes, runs.size(), time_interval
+			, successes ? spent / successes : std::numeric_limits<double>::infinity()
+			, cost_interval);
+	}
+}
+
+// Anytime report of every function of test_functions
+template <typename papso_t>
+void anytime_benchmark_suite(
+	hungbiu::hb_executor& etor
+	, std::size_t fork_count
+	, std::size_t iter_per_task
+	, std::size_t repetitions
+	, const papso_options_t& options = {}) {
+	for (std::size_t f = 0; f < test_functions::functions.size(); ++f) {
+		const optimization_problem_t problem{
+			test_functions::simd_functions[f]
+			, test_functions::bounds[f]
+			, test_functions::dimensions[f]
+		};
+		const auto runs = record_anytime_runs<papso_t>(etor, fork_count, iter_per_task, problem, repetitions, options);
+		anytime_report(test_functions::function_names[f], runs);
+	}
+}
+
+// --------------------------------------------------------------------------------
+// Self checks, run by `papso --check`. Each prints what failed and returns
+// false on failure
+
+// Sphere that counts its calls
+inline std::atomic<std::size_t> counted_calls{ 0 };
+inline double counted_sphere(iter beg, iter end) {
+	counted_calls.fetch_add(1, std::memory_order_relaxed);
+	return test_functions::functions[0](beg, end);
+}
+
+// Costly enough that the autotuner forks a subswarm per thread
+inline double counted_costly_sphere(iter beg, iter end) {
+	volatile double result = 0;
+	for (int i = 0; i < 200; ++i) {
+		result = test_functions::functions[0](beg, end);
+	}
+	counted_calls.fetch_add(1, std::memory_order_relaxed);
+	return result;
+}
+
+// Sphere that remembers its lowest value and cancels `cancelled_job` at
+// call `cancel_at`
+inline std::atomic<double> lowest_seen{ std::numeric_limits<double>::infinity() };
+inline hungbiu::job* cancelled_job = nullptr;
+inline std::size_t cancel_at = 0;
+inline double cancelling_sphere(iter beg, iter end) {
+	const double value = test_functions::functions[0](beg, end);
+	for (double low = lowest_seen.load(); value < low && !lowest_seen.compare_exchange_weak(low, value);) {}
+	if (cancel_at == counted_calls.fetch_add(1, std::memory_order_relaxed) + 1) {
+		cancelled_job->cancel();
+	}
+	return value;
+}
+
+// Largest relative error test_functions_accuracy_check() accepts for
+// function f. Reordered sums stay far below 1e-13; a schwefel_26 term is x
+// times sin(sqrt|x|), whose scaled argument is off by up to 1e-15 +
+// sqrt|x| * 1.2e-16 (see test_functions_simd.h), so it is off by |x| times
+// that: 1.9e-12 at the bound |x| = 500
+inline double simd_tolerance(std::size_t f) {
+	constexpr double reordering = 1e-13;
+	if (test_functions::functions[f] != test_functions::schwefel_26) {
+		return reordering;
+	}
+	const auto [min, max] = test_functions::bounds[f];
+	const double x = std::max(std::abs(min), std::abs(max));
+	return reordering + x * (1e-15 + std::sqrt(x) * 1.2e-16);
+}
+
+inline bool check_test_functions_accuracy() {
+	const auto errors = test_functions_accuracy_check();
+	bool ok = true;
+	for (std::size_t f = 0; f < errors.size(); ++f) {
+		if (!(errors[f] <= simd_tolerance(f))) {
+			std::printf("check_test_functions_accuracy: %s max error %.3e above %.3e\n"
+				, test_functions::function_names[f], errors[f], simd_tolerance(f));
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// The vector kernels agree with the scalar one on NaN, infinities, signed
+// zeros and positions out of the box, in the body and the tail
+inline bool check_update_kernels() {
+	constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+	constexpr double inf = std::numeric_limits<double>::infinity();
+	constexpr std::size_t dim = 11;
+	const double velocity[dim] = { nan, 0., 1., -1., 0., inf, 0., nan, -0., 0., 1. };
+	const double position[dim] = { 0., nan, 2., -5., -0., 0., 0., 1., 0., nan, 4.9 };
+	const double pbest[dim] = { 0., 0., nan, -5., 0., 0., -inf, 1., 0., 0., 5. };
+	const double lbest[dim] = { 0., 0., 0., nan, 0., 0., 0., 1., -0., 0., 5. };
+	double r[dim];
+	std::fill_n(r, dim, 0.5);
+	auto same = [](double a, double b) {
+		return (std::isnan(a) && std::isnan(b)) || (a == b && std::signbit(a) == std::signbit(b));
+	};
+
+	double v0[dim], x0[dim];
+	std::copy_n(velocity, dim, v0);
+	std::copy_n(position, dim, x0);
+	update_kernel::scalar(v0, x0, pbest, lbest, r, r, dim, -0., 5.);
+
+	std::vector<std::pair<const char*, update_kernel::kernel_type>> kernels;
+#if CPU_FEATURES_X86
+	if (cpu_features::avx2()) kernels.push_back({ "avx2", &update_kernel::avx2 });
+	if (cpu_features::avx512f()) kernels.push_back({ "avx512", &update_kernel::avx512 });
+#endif
+	bool ok = true;
+	for (auto [name, kernel] : kernels) {
+		double v[dim], x[dim];
+		std::copy_n(velocity, dim, v);
+		std::copy_n(position, dim, x);
+		kernel(v, x, pbest, lbest, r, r, dim, -0., 5.);
+		for (std::size_t d = 0; d < dim; ++d) {
+			if (!same(v[d], v0[d]) || !same(x[d], x0[d])) {
+				std::printf("check_update_kernels: %s at %zu: v %g x %g, scalar v %g x %g\n"
+					, name, d, v[d], x[d], v0[d], x0[d]);
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+// Every particle is initialized once and moved every iteration:
+// swarm_size * (iteration + 1) objective calls, whatever the fork count
+template <typename papso_t>
+bool check_evaluation_count(hungbiu::hb_executor& etor, std::size_t fork_count, papso_options_t options = {}
+	, func_t objective = &counted_sphere) {
+	const optimization_problem_t problem{ objective, test_functions::bounds[0], 30 };
+	options.swarm_size = options.swarm_size ? options.swarm_size : 40;
+	options.iteration = options.iteration ? options.iteration : 500;
+	options.seed = 1;
+	counted_calls.store(0);
+	auto [value, position] = papso_t::parallel_async_pso(etor, fork_count, 10, problem, options).get(etor);
+	const std::size_t expected = options.swarm_size * (options.iteration + 1);
+	const std::size_t calls = counted_calls.load();
+	if (calls != expected || position.size() != problem.dimension) {
+		std::printf("check_evaluation_count: fork_count %zu, %zu calls, expected %zu\n", fork_count, calls, expected);
+		return false;
+	}
+	return true;
+}
+
+// Batch sphere: counts the rows it evaluates in counted_calls and its calls
+// in batch_calls
+inline std::atomic<std::size_t> batch_calls{ 0 };
+inline void counted_batch_sphere(const double* positions, std::size_t count, std::size_t dimension
+	, std::size_t stride, double* values) {
+	batch_calls.fetch_add(1, std::memory_order_relaxed);
+	counted_calls.fetch_add(count, std::memory_order_relaxed);
+	for (std::size_t i = 0; i < count; ++i) {
+		const double* x = positions + i * stride;
+		double sum = 0;
+		for (std::size_t j = 0; j < dimension; ++j) {
+			sum += x[j] * x[j];
+		}
+		values[i] = sum;
+	}
+}
+
+// The batch overload evaluates every particle once per iteration with one
+// call per subswarm (one for the whole swarm at initialization). Its
+// particles see pbests of their subswarm one iteration late, so it does not
+// follow the scalar path, but must reach the same quality on the sphere
+template <typename papso_t>
+bool check_batch_problem(hungbiu::hb_executor& etor) {
+	const batch_optimization_problem_t batch{ &counted_batch_sphere, test_functions::bounds[0], 30 };
+	const optimization_problem_t scalar{ test_functions::functions[0], test_functions::bounds[0], 30 };
+	constexpr double target = 1e-12;
+	bool ok = true;
+	for (std::size_t fork_count : { 1, 3, 7 }) {
+		for (bool deterministic : { false, true }) {
+			papso_options_t options;
+			options.seed = 1;
+			options.iteration = 2000;
+			options.deterministic = deterministic;
+			counted_calls = 0;
+			batch_calls = 0;
+			const auto [value, position] = papso_t::parallel_async_pso(etor, fork_count, 10, batch, options).get(etor);
+			const std::size_t expected_rows = 40 * (options.iteration + 1);
+			const std::size_t expected_calls = 1 + fork_count * options.iteration;
+			if (counted_calls != expected_rows || batch_calls != expected_calls || position.size() != batch.dimension) {
+				std::printf("check_batch_problem: fork_count %zu, %zu rows in %zu calls, expected %zu in %zu\n"
+					, fork_count, counted_calls.load(), batch_calls.load(), expected_rows, expected_calls);
+				ok = false;
+			}
+			if (!deterministic) {
+				continue; // Quality is compared where it does not depend on the scheduling
+			}
+			const double reference = std::get<0>(papso_t::parallel_async_pso(etor, fork_count, 10, scalar, options).get(etor));
+			if (!(value <= std::max(target, reference))) {
+				std::printf("check_batch_problem: fork_count %zu, batch %g, scalar %g\n", fork_count, value, reference);
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+// Fork counts that do not divide the swarm size, and more forks than particles
+template <typename papso_t>
+bool check_partition(hungbiu::hb_executor& etor) {
+	bool ok = true;
+	for (std::size_t fork_count : { 1, 3, 7, 16, 30, 32, 39, 40, 64 }) {
+		ok = check_evaluation_count<papso_t>(etor, fork_count) && ok;
+		papso_options_t deterministic;
+		deterministic.deterministic = true;
+		ok = check_evaluation_count<papso_t>(etor, fork_count, deterministic) && ok;
+	}
+	return ok;
+}
+
+// numa_local subswarms initialize themselves: every row is touched and
+// initialized when the fork count does not divide the swarm size. Quality is
+// checked in deterministic mode, where it does not depend on the scheduling
+template <typename papso_t>
+bool check_numa_local(hungbiu::hb_executor& etor) {
+	bool ok = true;
+	for (std::size_t fork_count : { 7, 30 }) {
+		papso_options_t options;
+		options.numa_local = true;
+		options.iteration = 2000;
+		ok = check_evaluation_count<papso_t>(etor, fork_count, options) && ok;
+
+		const optimization_problem_t sphere{ test_functions::functions[0], test_functions::bounds[0], 30 };
+		options.seed = 1;
+		options.deterministic = true;
+		const double value = std::get<0>(papso_t::parallel_async_pso(etor, fork_count, 10, sphere, options).get(etor));
+		if (!(value < 1e-6)) {
+			std::printf("check_numa_local: fork_count %zu, sphere ended at %g\n", fork_count, value);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// Binary tree of forks, counts down `left` once per node
+struct fork_tree {
+	std::atomic<std::size_t>* left;
+	unsigned depth;
+	void operator()(hungbiu::hb_executor::worker_handle& wh) const {
+		if (depth) {
+			wh.execute(fork_tree{ left, depth - 1 });
+			wh.execute(fork_tree{ left, depth - 1 });
+		}
+		left->fetch_sub(1, std::memory_order_acq_rel);
+	}
+};
+
+// Fork bursts with pauses long enough for the workers to park, under every
+// steal policy with steal-half, so batch steals wake sleepers while parking.
+// A deadlocked executor can't be joined: exit instead of hanging
+inline bool check_steal_policies() {
+	using hungbiu::steal_policy;
+	constexpr unsigned depth = 10;
+	for (steal_policy policy : { steal_policy::linear, steal_policy::randomized
+		, steal_policy::hierarchical, steal_policy::last_victim }) {
+		hungbiu::executor_options_t options;
+		options.policy = policy;
+		options.steal_half = true;
+		hungbiu::hb_executor etor(8, options);
+		for (int round = 0; round < 200; ++round) {
+			std::atomic<std::size_t> left{ (std::size_t{ 2 } << depth) - 1 };
+			etor.execute(fork_tree{ &left, depth });
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+			while (left.load(std::memory_order_acquire)) {
+				if (std::chrono::steady_clock::now() > deadline) {
+					std::printf("check_steal_policies: policy %d stuck in round %d, %zu tasks left\n"
+						, static_cast<int>(policy), round, left.load());
+					std::fflush(stdout);
+					std::_Exit(1);
+				}
+				std::this_thread::yield();
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		etor.done();
+	}
+	return true;
+}
+
+// Deterministic runs with fork_count 0 give the same result on executors of
+// any size, with and without numa_local, and match an explicit count of 8
+template <typename papso_t>
+bool check_deterministic_fork_count() {
+	const optimization_problem_t problem{ test_functions::functions[4], test_functions::bounds[4], 30 };
+	bool ok = true;
+	for (bool numa_local : { false, true }) {
+		papso_options_t options;
+		options.seed = 42;
+		options.iteration = 1000;
+		options.deterministic = true;
+		options.numa_local = numa_local;
+		std::tuple<double, vec_t> expected;
+		{
+			hungbiu::hb_executor etor(1);
+			expected = papso_t::parallel_async_pso(etor, 8, 10, problem, options).get(etor);
+			etor.done();
+		}
+		for (std::size_t threads : { 1, 3, 8, 16 }) {
+			hungbiu::hb_executor etor(threads);
+			const auto result = papso_t::parallel_async_pso(etor, 0, 10, problem, options).get(etor);
+			etor.done();
+			if (result != expected) {
+				std::printf("check_deterministic_fork_count: numa_local %d, %zu threads: %g, expected %g\n"
+					, numa_local, threads, std::get<0>(result), std::get<0>(expected));
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+// soa_swarm_storage follows aos_swarm_storage exactly: same seed, same
+// deterministic run, same result, with rows padded (13, 30) or not (16)
+template <typename buffer_t>
+bool check_soa_storage(hungbiu::hb_executor& etor) {
+	using aos_papso = basic_papso<buffer_t, 2, 40, 500, aos_swarm_storage>;
+	using soa_papso = basic_papso<buffer_t, 2, 40, 500, soa_swarm_storage>;
+	bool ok = true;
+	for (std::size_t dimension : { 13, 16, 30 }) {
+		const optimization_problem_t problem{ test_functions::functions[4], test_functions::bounds[4], dimension };
+		for (std::size_t fork_count : { 1, 4 }) {
+			papso_options_t options;
+			options.seed = 3;
+			options.deterministic = true;
+			const auto aos = aos_papso::parallel_async_pso(etor, fork_count, 10, problem, options).get(etor);
+			const auto soa = soa_papso::parallel_async_pso(etor, fork_count, 10, problem, options).get(etor);
+			if (aos != soa) {
+				std::printf("check_soa_storage: dimension %zu, fork_count %zu: soa %g, aos %g\n"
+					, dimension, fork_count, std::get<0>(soa), std::get<0>(aos));
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+// seqlock_buffer as basic_papso's publication buffer. One worker runs the
+// subswarms in a fixed order, so the run reads the same published pbests
+// as with the default buffer and must give the same result
+template <typename papso_t>
+bool check_seqlock_buffer() {
+	constexpr std::size_t dimension = 30;
+	using seqlock_papso = basic_papso<hungbiu::seqlock_buffer<std::array<double, dimension>>, 2, 40, 1000>;
+	const optimization_problem_t problem{ test_functions::functions[4], test_functions::bounds[4], dimension };
+	bool ok = true;
+	for (auto publication : { papso_options_t::publication_t::immediate, papso_options_t::publication_t::boundary }) {
+		papso_options_t options;
+		options.seed = 5;
+		options.swarm_size = 40;
+		options.iteration = 1000;
+		options.publication = publication;
+		hungbiu::hb_executor etor(1);
+		auto run = seqlock_papso::parallel_async_pso(etor, 4, 10, problem, options);
+		const auto seqlock = run.get();
+		const auto expected = papso_t::parallel_async_pso(etor, 4, 10, problem, options).get();
+		etor.done();
+		if (seqlock != expected) {
+			std::printf("check_seqlock_buffer: publication %d, seqlock %g, expected %g\n"
+				, static_cast<int>(publication), std::get<0>(seqlock), std::get<0>(expected));
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// A future from an executor that is done has no state: get() and wait()
+// throw future_error(no_state) like std::future
+inline bool check_future_no_state() {
+	hungbiu::hb_executor etor(1);
+	etor.done();
+	auto future = etor.execute_return([](hungbiu::hb_executor::worker_handle&) { return 1; });
+	bool ok = !future.valid();
+	for (int call = 0; call < 2; ++call) {
+		try {
+			if (call) {
+				future.wait();
+			}
+			else {
+				future.get();
+			}
+			ok = false;
+		}
+		catch (const std::future_error& e) {
+			ok = ok && e.code() == std::future_errc::no_state;
+		}
+	}
+	if (!ok) {
+		std::printf("check_future_no_state: no future_error(no_state)\n");
+	}
+	return ok;
+}
+
+// A run whose job expired before any subswarm initialized itself reports
+// +inf and no position, not an uninitialized particle
+template <typename papso_t>
+bool check_cancelled_before_start(hungbiu::hb_executor& etor) {
+	hungbiu::job_scheduler scheduler{ etor };
+	papso_options_t options;
+	options.numa_local = true;
+	options.job = scheduler.make_job(0, 1., hungbiu::job_scheduler::clock::now() - std::chrono::seconds(1));
+	const optimization_problem_t sphere{ test_functions::functions[0], test_functions::bounds[0], 30 };
+	auto [value, position] = papso_t::parallel_async_pso(etor, 4, 10, sphere, options).get(etor);
+	if (value != std::numeric_limits<double>::infinity() || !position.empty()) {
+		std::printf("check_cancelled_before_start: got %g with %zu coordinates\n", value, position.size());
+		return false;
+	}
+	return true;
+}
+
+// Cancelling drops the continuations of the subswarms, the improvements they
+// held back must still be in the result: it is the lowest value ever evaluated
+template <typename papso_t>
+bool check_cancelled_publication(hungbiu::hb_executor& etor) {
+	using publication_t = papso_options_t::publication_t;
+	hungbiu::job_scheduler scheduler{ etor, 1 }; // The other subswarms wait in the queue
+	bool ok = true;
+	for (publication_t publication : { publication_t::boundary, publication_t::chunk_end }) {
+		papso_options_t options;
+		options.swarm_size = 80;
+		options.iteration = 100000;
+		options.publication = publication;
+		options.job = scheduler.make_job();
+		cancelled_job = options.job.get();
+		cancel_at = 80 + 3 * 80 * 50; // Last call of the third round of chunks
+		counted_calls = 0;
+		lowest_seen = std::numeric_limits<double>::infinity();
+		const optimization_problem_t sphere{ &cancelling_sphere, test_functions::bounds[0], 30 };
+		auto [value, position] = papso_t::parallel_async_pso(etor, 8, 50, sphere, options).get(etor);
+		if (value != lowest_seen.load() || position.size() != sphere.dimension) {
+			std::printf("check_cancelled_publication: publication %d, got %g, lowest evaluated %g\n"
+				, static_cast<int>(publication), value, lowest_seen.load());
+			ok = false;
+		}
+	}
+	cancelled_job = nullptr;
+	return ok;
+}
+
+// Autotuned fork count on an executor with more threads than half the swarm
+template <typename papso_t>
+bool check_auto_fork_count() {
+	hungbiu::hb_executor wide(32);
+	bool ok = true;
+	for (std::size_t swarm_size : { 17, 40 }) {
+		papso_options_t options;
+		options.swarm_size = swarm_size;
+		options.iteration = 200;
+		ok = check_evaluation_count<papso_t>(wide, 0, options) && ok;
+		options.numa_local = true; // One subswarm per thread
+		ok = check_evaluation_count<papso_t>(wide, 0, options) && ok;
+		options.numa_local = false;
+		options.iteration = 2000;
+		ok = check_evaluation_count<papso_t>(wide, 0, options, &counted_costly_sphere) && ok;
+	}
+	wide.done();
+	return ok;
+}
+
 #endif
\ No newline at end of file
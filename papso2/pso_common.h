@@ -0,0 +1,269 @@
+/*
+* What basic_papso, basic_sequential_pso and basic_sync_pso share: problem
+* and option types, the shape of a run, the ring neighborhood, pbest updates,
+* the stopping rules and the result of an engine that runs in the call.
+* The engines differ in how they schedule particles, not in these rules.
+*/
+#ifndef _PSO_COMMON
+#define _PSO_COMMON
+#include <vector>
+#include <tuple>
+#include <memory>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include "executor.h"
+#include "job_scheduler.h"
+
+using vec_t = std::vector<double>;
+using iter = vec_t::const_iterator;
+using func_t = double(*)(iter, iter);
+using bound_t = std::pair<double, double>;
+
+struct optimization_problem_t {
+	const func_t function;
+	bound_t feasible_bound;
+	size_t dimension;
+};
+
+// Evaluates `count` particles in one call: particle i occupies
+// [positions + i * stride, positions + i * stride + dimension), its
+// fitness is written to values[i]
+using batch_func_t = void(*)(const double* positions, size_t count, size_t dimension, size_t stride, double* values);
+
+struct batch_optimization_problem_t {
+	const batch_func_t function;
+	bound_t feasible_bound;
+	size_t dimension;
+};
+
+struct papso_options_t {
+	// Shape of the run, 0 keeps the default of the engine's template arguments
+	size_t swarm_size = 0;
+	size_t neighbor_size = 0;
+	size_t iteration = 0;
+
+	// Subswarm k draws iteration i from stream (seed, k, i + 1)
+	std::uint64_t seed = std::random_device{}();
+
+	// Let the first worker running a subswarm allocate and initialize it, so
+	// its pages land on that worker's NUMA node (pin the executor's threads).
+	// Subswarm k is then initialized from (seed, k, 0) instead of all of the
+	// swarm from (seed, 0, 0)
+	bool numa_local = false;
+
+	// When a pbest improvement becomes visible to other subswarms
+	enum class publication_t {
+		immediate, // Every improvement
+		boundary,  // Particles in another subswarm's neighborhood at once, the rest at the end of the run
+		chunk_end  // Improvements of a task are published when it finishes its iterations
+	};
+	publication_t publication = publication_t::immediate;
+
+	// Subswarms see each other only through snapshots of the pbests taken at
+	// a barrier every iteration_per_task iterations (20 at most if it is 0,
+	// no autotuning), and the criteria are checked there over the whole swarm.
+	// fork_count 0 means 8 subswarms (fewer for a smaller swarm), not a count
+	// from the executor or timings. The result depends on the problem, the
+	// options, fork_count and iteration_per_task only, whatever the executor;
+	// `publication` is ignored, and only a time budget or a job can stop the
+	// run at another barrier
+	bool deterministic = false;
+
+	// Checked by every task when it ends its chunk of iterations; once one
+	// holds, no task forks its continuation. Defaults disable each criterion
+	struct stop_criteria_t {
+		double target = -std::numeric_limits<double>::infinity(); // Best value at or below
+		size_t stagnation = 0;      // Iterations without a better best value
+		std::chrono::steady_clock::duration time_budget{ 0 }; // Wall clock from launch
+		size_t max_evaluations = 0; // Objective calls, initialization included
+	};
+	stop_criteria_t stop;
+
+	// Called by the task that lowered the best value found so far, at the end
+	// of its chunk: (objective evaluations so far, best value). Calls come from
+	// any worker and may overlap
+	std::function<void(size_t, double)> progress;
+
+	// Run as a job of a job_scheduler: its tasks share the executor with
+	// other jobs, and no continuation is forked once the job is cancelled
+	// or past its deadline (the result is the best found so far)
+	std::shared_ptr<hungbiu::job> job;
+};
+
+
+// Engine defaults overridden by `options`; throws std::invalid_argument
+// naming `engine` if the neighborhood does not fit in the swarm
+inline void apply_shape(const papso_options_t& options, const char* engine
+	, size_t& swarm_size, size_t& neighbor_size, size_t& iteration) {
+	if (options.swarm_size) {
+		swarm_size = options.swarm_size;
+	}
+	if (options.neighbor_size) {
+		neighbor_size = options.neighbor_size;
+	}
+	if (options.iteration) {
+		iteration = options.iteration;
+	}
+	if (0 == swarm_size || neighbor_size / 2 >= swarm_size) {
+		throw std::invalid_argument(std::string{ engine } + ": bad neighborhood for the swarm size");
+	}
+}
+
+// Particle at `offset` from i on a ring of `swarm_size`, |offset| < swarm_size
+inline size_t ring_neighbor(size_t i, int offset, size_t swarm_size) noexcept {
+	const std::ptrdiff_t n = static_cast<std::ptrdiff_t>(i) + offset;
+	if (n < 0) {
+		return n + swarm_size;
+	}
+	return static_cast<size_t>(n) < swarm_size ? n : n - swarm_size;
+}
+
+// Best of idx and the neighbor_size / 2 particles on each side of it, by
+// `value_of(j)`, the pbest value of particle j as the engine sees it. Ties
+// keep idx, then the first one from the left
+template <typename value_of_t>
+size_t lbest_index(size_t idx, size_t neighbor_size, size_t swarm_size, value_of_t&& value_of) {
+	size_t lbest_idx = idx; // !!Middle of neighbor
+	double lbest_val = value_of(idx);
+	const int max_offset = static_cast<int>(neighbor_size / 2); // Always positive
+	for (int offset = -max_offset; offset <= max_offset; ++offset) {
+		const size_t neighbor = ring_neighbor(idx, offset, swarm_size);
+		const double v = value_of(neighbor);
+		if (v < lbest_val) {
+			lbest_val = v;
+			lbest_idx = neighbor;
+		}
+	}
+	return lbest_idx;
+}
+
+// Returns true if the pbest of particle i improved
+template <typename storage_t>
+bool update_pbest(storage_t& swarm, size_t i) noexcept {
+	const double value = swarm.value(i);
+	if (value < swarm.best_value(i)) {
+		swarm.best_value(i) = value;
+		std::copy_n(swarm.position(i), swarm.dimension(), swarm.best_position(i));
+		return true;
+	}
+	return false;
+}
+
+// Particle with the lowest pbest, the first one on ties
+template <typename storage_t>
+size_t best_index(const storage_t& swarm) noexcept {
+	size_t best_idx = 0;
+	for (size_t i = 1; i < swarm.size(); ++i) {
+		if (swarm.best_value(i) < swarm.best_value(best_idx)) {
+			best_idx = i;
+		}
+	}
+	return best_idx;
+}
+
+// papso_options_t::stop_criteria_t and the progress callback of a run; the
+// bookkeeping (evaluations, best so far) is the engine's
+struct stop_rules_t {
+	papso_options_t::stop_criteria_t criteria;
+	std::function<void(size_t, double)> progress;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+	// At launch, the time budget starts now
+	void set(const papso_options_t& options) {
+		criteria = options.stop;
+		progress = options.progress;
+		if (options.stop.time_budget.count() > 0) {
+			deadline = std::chrono::steady_clock::now() + options.stop.time_budget;
+		}
+	}
+	bool counts_evaluations() const noexcept {
+		return criteria.max_evaluations || progress;
+	}
+	// Whether the best value must be known at a check
+	bool tracks_best() const noexcept {
+		return criteria.target > -std::numeric_limits<double>::infinity() || criteria.stagnation || progress;
+	}
+	bool out_of_evaluations(size_t evaluated) const noexcept {
+		return criteria.max_evaluations && evaluated >= criteria.max_evaluations;
+	}
+	// `best` after iteration `iteration_end`, the last improvement at `improved_at`
+	bool reached_quality(double best, size_t iteration_end, size_t improved_at) const noexcept {
+		return best <= criteria.target
+			|| (criteria.stagnation && iteration_end >= improved_at + criteria.stagnation);
+	}
+	bool out_of_time() const noexcept {
+		return std::chrono::steady_clock::time_point::max() != deadline
+			&& std::chrono::steady_clock::now() >= deadline;
+	}
+};
+
+// Stopping state of an engine that checks from one thread at a time
+class serial_stop_t {
+	stop_rules_t rules_;
+	size_t evaluations_ = 0;
+	double best_seen_ = std::numeric_limits<double>::max();
+	size_t last_improvement_ = 0;
+
+public:
+	void set(const papso_options_t& options) {
+		rules_.set(options);
+	}
+
+	// After initializing `swarm`
+	template <typename storage_t>
+	void start(const storage_t& swarm) {
+		evaluations_ = swarm.size();
+		if (rules_.progress) {
+			best_seen_ = swarm.best_value(best_index(swarm));
+			rules_.progress(evaluations_, best_seen_);
+		}
+	}
+
+	// After every particle of `swarm` ran iterations [first, last)
+	template <typename storage_t>
+	bool reached(const storage_t& swarm, const std::pair<size_t, size_t> iteration_range) {
+		evaluations_ += swarm.size() * (iteration_range.second - iteration_range.first);
+		bool stop = rules_.out_of_evaluations(evaluations_);
+
+		if (rules_.tracks_best()) {
+			const double best = swarm.best_value(best_index(swarm));
+			if (best < best_seen_) {
+				best_seen_ = best;
+				last_improvement_ = iteration_range.second;
+				if (rules_.progress) {
+					rules_.progress(evaluations_, best);
+				}
+			}
+			stop = stop || rules_.reached_quality(best, iteration_range.second, last_improvement_);
+		}
+		return stop || rules_.out_of_time();
+	}
+};
+
+// The result of an engine that finished in the call, for code written
+// against basic_papso::papso_result_t
+class finished_result_t {
+	std::tuple<double, vec_t> result_;
+public:
+	explicit finished_result_t(std::tuple<double, vec_t> result)
+		: result_(std::move(result)) {}
+
+	bool ready() const noexcept {
+		return true;
+	}
+	std::tuple<double, vec_t> get() {
+		return std::move(result_);
+	}
+	std::tuple<double, vec_t> get(hungbiu::hb_executor&) {
+		return get();
+	}
+};
+
+#endif // _PSO_COMMON
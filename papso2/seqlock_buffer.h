@@ -0,0 +1,80 @@
+#ifndef _SEQLOCK_BUFFER
+#define _SEQLOCK_BUFFER
+#include <atomic>
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <thread>
+#include "spmc_buffer.h"
+
+namespace hungbiu {
+	// For:
+	// 1) Single writer that might update at an arbitrary frequency
+	// 2) Multiple readers that never write shared memory: a reader copies
+	//    the latest slot and retries if the writer touched it meanwhile
+	// Two versioned slots, the writer fills the one readers are not directed
+	// to, so a reader only retries if it is slower than two writes.
+	// Requires T to be trivially copyable and fixed-size (e.g. std::array)
+	template <typename T>
+	requires std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>
+	class seqlock_buffer {
+		struct slot_type {
+			std::atomic<unsigned> seq alignas(64) = { 0 }; // Odd while being written
+			T value = {};
+		};
+
+		std::atomic<unsigned> latest_ alignas(64) = { 0 };
+		std::array<slot_type, 2> slots_;
+
+	public:
+		// Owns a snapshot, nothing to release
+		class viewer {
+			T value_;
+			friend class seqlock_buffer;
+		public:
+			viewer() = default;
+			void unlock() noexcept {}
+			const T& operator*() const noexcept { return value_; }
+			const T* operator->() const noexcept { return &value_; }
+		};
+
+		seqlock_buffer() {}
+		seqlock_buffer(seqlock_buffer&& oth) noexcept { // Not thread-safe, only for containers
+			slots_[0].value = oth.slots_[oth.latest_.load()].value;
+		}
+		~seqlock_buffer() {}
+
+		// Single writer
+		template <typename U>
+		void put(U&& val) {
+			const unsigned next = 1 - latest_.load(std::memory_order_relaxed);
+			slot_type& slot = slots_[next];
+			const unsigned seq = slot.seq.load(std::memory_order_relaxed);
+			slot.seq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			assign_payload(slot.value, std::forward<U>(val));
+
+			slot.seq.store(seq + 2, std::memory_order_release);
+			latest_.store(next, std::memory_order_release);
+		}
+
+		viewer get() const noexcept {
+			viewer v;
+			for (;;) {
+				const slot_type& slot = slots_[latest_.load(std::memory_order_acquire)];
+				const unsigned seq = slot.seq.load(std::memory_order_acquire);
+				if (seq & 1) {
+					std::this_thread::yield();
+					continue;
+				}
+				std::memcpy(&v.value_, &slot.value, sizeof(T));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (seq == slot.seq.load(std::memory_order_relaxed)) {
+					return v;
+				}
+			}
+		}
+	};
+}
+#endif
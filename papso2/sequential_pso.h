@@ -0,0 +1,184 @@
+/*
+* Single-threaded PSO with the interface of basic_papso
+* Runs on the calling thread without atomics, publication buffers, tasks or
+* variants: particles read the pbest of their neighbors in place. With the
+* same seed and publication_t::immediate it follows basic_papso run with
+* fork_count = 1 exactly, so it is the baseline for speedups as well as the
+* engine for single-core deployments.
+*/
+#ifndef _SEQUENTIAL_PSO
+#define _SEQUENTIAL_PSO
+#include <vector>
+#include <tuple>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include "papso2.h"
+#include "pso_common.h"
+
+// Template arguments are defaults, see papso_options_t
+template <size_t default_neighbor_size, size_t default_swarm_size, size_t default_iteration,
+	typename storage_t = aos_swarm_storage>
+class basic_sequential_pso {
+public:
+	using size_t = std::size_t;
+	using range_t = std::pair<size_t, size_t>;
+
+private:
+	const func_t f;
+	const batch_func_t batch_f = nullptr;
+	size_t dimension;
+	double min, max;
+	size_t swarm_size = default_swarm_size;
+	size_t neighbor_size = default_neighbor_size;
+	size_t iteration = default_iteration;
+	const update_kernel::kernel_type move_kernel = update_kernel::get();
+	storage_t swarm;
+	vec_t random_block;
+
+	serial_stop_t stop; // See papso_options_t::stop_criteria_t
+
+public:
+	basic_sequential_pso(const func_t f, const bound_t& bounds, size_t dim) :
+		f(f),
+		dimension(dim), min(bounds.first), max(bounds.second) {}
+	basic_sequential_pso(const batch_func_t batch_f, const bound_t& bounds, size_t dim) :
+		f(nullptr), batch_f(batch_f),
+		dimension(dim), min(bounds.first), max(bounds.second) {}
+	basic_sequential_pso(const basic_sequential_pso&) = delete;
+
+private:
+	void evaluate_range(const range_t range) noexcept {
+		if (batch_f) {
+			swarm.evaluate_batch(range.first, range.second, batch_f);
+		}
+		else {
+			for (size_t i = range.first; i < range.second; ++i) {
+				swarm.value(i) = swarm.evaluate(i, f);
+			}
+		}
+	}
+
+	// Substream 0 of the stream, iterations start from substream 1
+	void initialize_swarm(canonical_rng& rng) {
+		random_block.resize(2 * dimension);
+		double* r = random_block.data();
+		auto random_xi = [&](size_t j) {
+			return min + r[j] * (max - min);
+		};
+
+		for (size_t i = 0; i < swarm_size; ++i) { // particle i
+			double* position = swarm.position(i);
+			double* best_position = swarm.best_position(i);
+			double* velocity = swarm.velocity(i);
+			rng.fill(r, r + 2 * dimension);
+			for (size_t j = 0; j < dimension; ++j) { // dimension j
+				position[j] = random_xi(j);
+				best_position[j] = position[j];
+				velocity[j] = (random_xi(dimension + j) - position[j]) / 2.0;
+			}
+		}
+
+		evaluate_range({ 0, swarm_size });
+		for (size_t i = 0; i < swarm_size; ++i) {
+			swarm.best_value(i) = swarm.value(i);
+		}
+	}
+
+	const double* get_lbest(size_t idx) const noexcept {
+		return swarm.best_position(lbest_index(idx, neighbor_size, swarm_size, [this](size_t j) {
+			return swarm.best_value(j);
+		}));
+	}
+
+	void move_particle(size_t idx, const double* lbest, canonical_rng& rng) {
+		double* r = random_block.data();
+		rng.fill(r, r + 2 * dimension);
+		move_kernel(swarm.velocity(idx), swarm.position(idx)
+			, swarm.best_position(idx), lbest
+			, r, r + dimension
+			, dimension, min, max);
+	}
+
+	void iterate(size_t i, canonical_rng& rng) {
+		rng.seek(static_cast<std::uint32_t>(i + 1));
+		if (batch_f) {
+			for (size_t j = 0; j < swarm_size; ++j) {
+				move_particle(j, get_lbest(j), rng);
+			}
+			evaluate_range({ 0, swarm_size });
+			for (size_t j = 0; j < swarm_size; ++j) {
+				update_pbest(swarm, j);
+			}
+		}
+		else {
+			for (size_t j = 0; j < swarm_size; ++j) {
+				move_particle(j, get_lbest(j), rng);
+				swarm.value(j) = swarm.evaluate(j, f);
+				update_pbest(swarm, j);
+			}
+		}
+	}
+
+	std::tuple<double, vec_t> run(const papso_options_t& options, size_t check_interval) {
+		apply_shape(options, "sequential_pso", swarm_size, neighbor_size, iteration);
+		stop.set(options);
+
+		swarm.resize(swarm_size, dimension);
+		random_block.resize(2 * dimension);
+		canonical_rng rng{ options.seed, 0 };
+		initialize_swarm(rng);
+		stop.start(swarm);
+
+		const size_t interval = std::max<size_t>(1, check_interval);
+		for (size_t first = 0; first < iteration; first += interval) {
+			const range_t iteration_range{ first, std::min(first + interval, iteration) };
+			for (size_t i = iteration_range.first; i < iteration_range.second; ++i) {
+				iterate(i, rng);
+			}
+			if (stop.reached(swarm, iteration_range)) { // Same rules as basic_papso
+				break;
+			}
+		}
+
+		const size_t gbest = best_index(swarm);
+		const double* best_first = swarm.best_position(gbest);
+		return { swarm.best_value(gbest), vec_t(best_first, best_first + dimension) };
+	}
+
+public:
+	// Runs on the calling thread. Stopping criteria are checked every
+	// `check_interval` iterations, like basic_papso does at task boundaries
+	static std::tuple<double, vec_t> optimize(const optimization_problem_t& problem
+		, const papso_options_t& options = {}, size_t check_interval = 1) {
+		basic_sequential_pso engine{ problem.function, problem.feasible_bound, problem.dimension };
+		return engine.run(options, check_interval);
+	}
+
+	static std::tuple<double, vec_t> optimize(const batch_optimization_problem_t& problem
+		, const papso_options_t& options = {}, size_t check_interval = 1) {
+		basic_sequential_pso engine{ problem.function, problem.feasible_bound, problem.dimension };
+		return engine.run(options, check_interval);
+	}
+
+	using papso_result_t = finished_result_t;
+
+	// Drop-in for basic_papso::parallel_async_pso: the run completes before
+	// returning. `etor` and fork_count are ignored, iter_per_task is the
+	// interval of the stopping checks; publication, NUMA and job options
+	// do not apply
+	static papso_result_t parallel_async_pso(hungbiu::hb_executor&, size_t /* fork_count */, size_t iter_per_task
+		, const optimization_problem_t& problem, const papso_options_t& options = {}) {
+		return papso_result_t{ optimize(problem, options, iter_per_task) };
+	}
+
+	static papso_result_t parallel_async_pso(hungbiu::hb_executor&, size_t /* fork_count */, size_t iter_per_task
+		, const batch_optimization_problem_t& problem, const papso_options_t& options = {}) {
+		return papso_result_t{ optimize(problem, options, iter_per_task) };
+	}
+};
+
+using sequential_pso = basic_sequential_pso<2, 40, 5000>;
+
+#endif // _SEQUENTIAL_PSO
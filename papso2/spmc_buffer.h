@@ -5,6 +5,11 @@
 #include <array>
 #include <mutex>
 #include <shared_mutex>
+#include <iterator>
+#include <type_traits>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
 #if DEBUG_PRINT
 #include <stdio.h>
 #endif
@@ -12,6 +17,34 @@
 // ԣ
 
 namespace hungbiu {
+	// Copy a payload into a slot. Lets a contiguous range (e.g. std::span)
+	// be published into a container slot, reusing the slot's capacity, or
+	// into a fixed-size slot (e.g. std::array) that must be large enough
+	template <typename T, typename U>
+	void assign_payload(T& dst, U&& src) {
+		if constexpr (std::is_assignable_v<T&, U&&>) {
+			dst = std::forward<U>(src);
+		}
+		else if constexpr (requires { dst.assign(std::begin(src), std::end(src)); }) {
+			dst.assign(std::begin(src), std::end(src));
+		}
+		else {
+			if (std::size(src) > std::size(dst)) {
+				throw std::length_error("payload does not fit the slot");
+			}
+			std::copy(std::begin(src), std::end(src), std::begin(dst));
+		}
+	}
+
+#ifdef COUNT_PENDING_WRITE
+	// How often spmc_buffer::put() found no free slot, process-wide
+	struct pending_write_counters {
+		static inline std::atomic<size_t> parked{ 0 };     // Value left in the pending slot
+		static inline std::atomic<size_t> superseded{ 0 }; // Pending value replaced by a newer put()
+		static inline std::atomic<size_t> flushed{ 0 };    // Pending value published by a reader
+	};
+#endif
+
 	// For:
 	// 1) Single writer that might update at an arbitrary frequency
 	// 2) Multiple readers that might take an arbitrary period of time;
@@ -123,8 +156,17 @@ namespace hungbiu {
 		};
 		
 	private:
-		std::atomic<T*> pending_value_ = { nullptr }; // Non-const for buffer reuse
-		std::atomic<size_t> read_index_ = { 0 };
+		// Pending slot, used when put() finds every slot busy
+		// Empty -> Writing -> Ready: writer parks a value
+		// Ready -> Writing:          writer supersedes it
+		// Ready -> Claimed -> Empty: a reader holding the next slot publishes it
+		static constexpr int Empty = 0;
+		static constexpr int Writing = 1;
+		static constexpr int Ready = 2;
+		static constexpr int Claimed = 3;
+		std::atomic<int> pending_state_ alignas(64) = { Empty };
+		T pending_value_ = {}; // Keeps its capacity, so parking never allocates
+		std::atomic<size_t> read_index_ alignas(64) = { 0 };
 		std::array<slot_type, Associativity> buffers_;
 
 		std::pair<counter_type*, const T*> acquire_read() noexcept {
@@ -215,12 +257,36 @@ namespace hungbiu {
 			return { this, pc, widx };
 		}	
 
+		// Writer only. Returns true if the writer now owns the pending slot,
+		// i.e. it superseded a parked value
+		bool retract_pending_write() noexcept {
+			for (;;) {
+				int state = pending_state_.load(std::memory_order_acquire);
+				if (Claimed == state) { // A reader is publishing it, keep the order of values
+					std::this_thread::yield();
+					continue;
+				}
+				if (Empty == state) {
+					return false;
+				}
+				if (pending_state_.compare_exchange_weak(state, Writing, std::memory_order_acq_rel)) {
+#ifdef COUNT_PENDING_WRITE
+					pending_write_counters::superseded.fetch_add(1, std::memory_order_relaxed);
+#endif
+					return true;
+				}
+			}
+		}
+
+		// Writer only, owns the slot (Empty or Writing)
 		template <typename U>
-		void add_pending_write(U&& val, T* ptr) {			
-			T* pnew = ptr 
-						? new(ptr) T(std::forward<U>(val))  // Construct in-place
-						: new T(std::forward<U>(val));		// Allocate to construct
-			T* pold = pending_value_.exchange(pnew, std::memory_order_acq_rel);
+		void add_pending_write(U&& val) {
+			pending_state_.store(Writing, std::memory_order_relaxed);
+			assign_payload(pending_value_, std::forward<U>(val));
+			pending_state_.store(Ready, std::memory_order_release);
+#ifdef COUNT_PENDING_WRITE
+			pending_write_counters::parked.fetch_add(1, std::memory_order_relaxed);
+#endif
 		}
 
 		// if (buffer[read_idx + 1].count == 0 && pending_update) 
@@ -231,11 +297,7 @@ namespace hungbiu {
 		// else return
 		void proceed_pending_write() noexcept {
 			// Check if there is any pending write
-			if (nullptr == pending_value_.load(std::memory_order_acquire)) {
-				return;
-			}
-			const T* pval = pending_value_.exchange(nullptr, std::memory_order_acq_rel);
-			if (!pval) {
+			if (Ready != pending_state_.load(std::memory_order_acquire)) {
 				return;
 			}
 
@@ -254,33 +316,37 @@ namespace hungbiu {
 					return;
 				}
 
+				int state = Ready;
+				if (!pending_state_.compare_exchange_strong(state, Claimed, std::memory_order_acq_rel)) {
+					return; // Superseded or claimed by another reader
+				}
+
 #if DEBUG_PRINT
 				printf("write to next\n");
 #endif
-				buffers_[wlock.write_idx()].value = std::move(*pval);
+				buffers_[wlock.write_idx()].value = pending_value_; // Copy, reuses capacity
 			}
 
 			// Publish new value
 			read_index_.fetch_add(1, std::memory_order_acq_rel);
-
-			// Clear
-			delete pval;
+			pending_state_.store(Empty, std::memory_order_release);
+#ifdef COUNT_PENDING_WRITE
+			pending_write_counters::flushed.fetch_add(1, std::memory_order_relaxed);
+#endif
 		}
 
 	public:
 		spmc_buffer() {}
 		spmc_buffer(spmc_buffer&& oth) noexcept {
-			auto p = oth.pending_value_.exchange(nullptr);
-			if (!p) {
-				auto idx = oth.read_index_.load();
+			if (Ready != oth.pending_state_.exchange(Empty)) {
+				auto idx = oth.read_index_.load() % Associativity;
 				slot_type& slot = oth.buffers_[idx];
 				counter_type* pc = &(slot.counter);
 				write_lock wlock_oth{ &oth, pc, idx };
 				buffers_[0].value = std::move(slot.value);
 			}
 			else {
-				buffers_[0].value = std::move(*p);
-				delete p;
+				buffers_[0].value = std::move(oth.pending_value_);
 			}
 		}
 		~spmc_buffer() {}
@@ -288,11 +354,8 @@ namespace hungbiu {
 		// Single writer
 		template <typename U>
 		void put(U&& val) {
-			// Retrieve if there is a pending write
-			T* old = pending_value_.load(std::memory_order_acquire);
-			if (old) {
-				old = pending_value_.exchange(nullptr);
-			}
+			// Take back a parked value, this one is newer
+			const bool owns_pending = retract_pending_write();
 
 #if DEBUG_PRINT
 			printf("put(): ");
@@ -312,18 +375,21 @@ namespace hungbiu {
 #if DEBUG_PRINT
 					printf("add to pending write\n");
 #endif
-					add_pending_write(std::forward<U>(val), old);
+					add_pending_write(std::forward<U>(val));
 					return;
 				}
 #if DEBUG_PRINT
 				printf("direct write\n");
 #endif
 				write_idx = wlock.write_idx();
-				buffers_[write_idx].value = std::forward<U>(val);
+				assign_payload(buffers_[write_idx].value, std::forward<U>(val));
 			}
 			
 			// Publish new value
 			read_index_.store(write_idx, std::memory_order_release);
+			if (owns_pending) {
+				pending_state_.store(Empty, std::memory_order_release);
+			}
 		}
 
 		viewer get() noexcept {
@@ -331,6 +397,14 @@ namespace hungbiu {
 			read_lock rlock = { this, pcounter };
 			return viewer{ std::move(rlock), pval };
 		}
+
+		// Size every slot up front, so put() never allocates. Not thread-safe
+		void resize(size_t dim) requires requires (T& t, size_t n) { t.resize(n); } {
+			for (auto& slot : buffers_) {
+				slot.value.resize(dim);
+			}
+			pending_value_.resize(dim);
+		}
 	};
 
 
@@ -376,7 +450,12 @@ namespace hungbiu {
 		template <typename U>
 		void put(U&& val) {
 			std::lock_guard guard{ smtx_ };
-			val_ = std::forward<U>(val);
+			assign_payload(val_, std::forward<U>(val));
+		}
+
+		// Not thread-safe
+		void resize(size_t dim) requires requires (T& t, size_t n) { t.resize(n); } {
+			val_.resize(dim);
 		}
 	};
 }
@@ -0,0 +1,181 @@
+/*
+* Swarm storage policies for basic_papso
+* A policy owns positions, velocities and pbest of every particle and hands
+* out raw rows, so the optimizer does not care how particles are laid out.
+*/
+#ifndef _SWARM_STORAGE
+#define _SWARM_STORAGE
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+
+// Array of structures: every particle owns three heap vectors
+class aos_swarm_storage {
+	using vec_t = std::vector<double>;
+
+	struct particle {
+		double value;
+		double best_value;
+		vec_t velocity;
+		vec_t position;
+		vec_t best_position;
+	};
+
+	std::vector<particle> particles_;
+	std::size_t dimension_ = 0;
+
+public:
+	// touch == false leaves the rows to first_touch()
+	void resize(std::size_t swarm_size, std::size_t dimension, bool touch = true) { // Tons of allocations
+		dimension_ = dimension;
+		particles_.resize(swarm_size);
+		if (touch) {
+			first_touch(0, swarm_size);
+		}
+	}
+
+	// Allocate rows [first, last) from the calling thread
+	void first_touch(std::size_t first, std::size_t last) {
+		for (std::size_t i = first; i < last; ++i) {
+			auto& p = particles_[i];
+			p.position.resize(dimension_);
+			p.best_position.resize(dimension_);
+			p.velocity.resize(dimension_);
+		}
+	}
+
+	std::size_t size() const noexcept { return particles_.size(); }
+	std::size_t dimension() const noexcept { return dimension_; }
+
+	double* position(std::size_t i) noexcept { return particles_[i].position.data(); }
+	double* velocity(std::size_t i) noexcept { return particles_[i].velocity.data(); }
+	double* best_position(std::size_t i) noexcept { return particles_[i].best_position.data(); }
+	const double* position(std::size_t i) const noexcept { return particles_[i].position.data(); }
+	const double* best_position(std::size_t i) const noexcept { return particles_[i].best_position.data(); }
+
+	double& value(std::size_t i) noexcept { return particles_[i].value; }
+	double& best_value(std::size_t i) noexcept { return particles_[i].best_value; }
+	double best_value(std::size_t i) const noexcept { return particles_[i].best_value; }
+
+	template <typename F>
+	double evaluate(std::size_t i, F f) const {
+		const vec_t& x = particles_[i].position;
+		return f(x.cbegin(), x.cend());
+	}
+
+	// Gather [first, last) into one matrix for a batch objective
+	template <typename F>
+	void evaluate_batch(std::size_t first, std::size_t last, F f) {
+		static thread_local vec_t matrix, values;
+		const std::size_t count = last - first;
+		matrix.resize(count * dimension_);
+		values.resize(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			std::copy_n(position(first + i), dimension_, matrix.data() + i * dimension_);
+		}
+		f(matrix.data(), count, dimension_, dimension_, values.data());
+		for (std::size_t i = 0; i < count; ++i) {
+			particles_[first + i].value = values[i];
+		}
+	}
+};
+
+// Structure of arrays: positions, velocities and pbest of the whole swarm
+// live in three contiguous blocks of one 64-byte aligned allocation.
+// Rows are padded to a cache line so every particle starts aligned.
+class soa_swarm_storage {
+	using vec_t = std::vector<double>;
+
+	static constexpr std::size_t alignment = 64;
+	static constexpr std::size_t lane_count = alignment / sizeof(double);
+
+	struct aligned_deleter {
+		void operator()(double* p) const noexcept {
+			::operator delete[](p, std::align_val_t{ alignment });
+		}
+	};
+
+	static std::size_t round_up(std::size_t n) noexcept {
+		return (n + lane_count - 1) / lane_count * lane_count;
+	}
+
+	std::unique_ptr<double[], aligned_deleter> block_;
+	std::size_t swarm_size_ = 0;
+	std::size_t dimension_ = 0;
+	std::size_t stride_ = 0;
+	double* positions_ = nullptr;
+	double* velocities_ = nullptr;
+	double* best_positions_ = nullptr;
+	double* values_ = nullptr;
+	double* best_values_ = nullptr;
+
+public:
+	// touch == false leaves the pages untouched, so the OS places each one on
+	// the NUMA node of the thread calling first_touch() for it
+	void resize(std::size_t swarm_size, std::size_t dimension, bool touch = true) { // One allocation per run
+		swarm_size_ = swarm_size;
+		dimension_ = dimension;
+		stride_ = round_up(dimension);
+
+		const std::size_t matrix = swarm_size * stride_;
+		const std::size_t scalars = round_up(swarm_size);
+		const std::size_t count = 3 * matrix + 2 * scalars;
+		block_.reset(static_cast<double*>(
+			::operator new[](count * sizeof(double), std::align_val_t{ alignment })));
+		positions_ = block_.get();
+		velocities_ = positions_ + matrix;
+		best_positions_ = velocities_ + matrix;
+		values_ = best_positions_ + matrix;
+		best_values_ = values_ + scalars;
+		if (touch) {
+			std::fill_n(block_.get(), count, 0.);
+		}
+	}
+
+	// Zero rows [first, last) from the calling thread
+	void first_touch(std::size_t first, std::size_t last) {
+		const std::size_t count = (last - first) * stride_;
+		std::fill_n(position(first), count, 0.);
+		std::fill_n(velocity(first), count, 0.);
+		std::fill_n(best_position(first), count, 0.);
+		std::fill_n(values_ + first, last - first, 0.);
+		std::fill_n(best_values_ + first, last - first, 0.);
+	}
+
+	std::size_t size() const noexcept { return swarm_size_; }
+	std::size_t dimension() const noexcept { return dimension_; }
+	std::size_t stride() const noexcept { return stride_; }
+
+	double* position(std::size_t i) noexcept { return positions_ + i * stride_; }
+	double* velocity(std::size_t i) noexcept { return velocities_ + i * stride_; }
+	double* best_position(std::size_t i) noexcept { return best_positions_ + i * stride_; }
+	const double* position(std::size_t i) const noexcept { return positions_ + i * stride_; }
+	const double* best_position(std::size_t i) const noexcept { return best_positions_ + i * stride_; }
+
+	double& value(std::size_t i) noexcept { return values_[i]; }
+	double& best_value(std::size_t i) noexcept { return best_values_[i]; }
+	double best_value(std::size_t i) const noexcept { return best_values_[i]; }
+
+	// Objectives take vector iterators, so the row is staged through a
+	// per-thread buffer: one copy of `dimension` doubles per call. For cheap
+	// objectives at a few tens of dimensions that copy can cost as much as
+	// the call, and the layout gains little over aos_swarm_storage; batch
+	// objectives read the rows in place, see evaluate_batch()
+	template <typename F>
+	double evaluate(std::size_t i, F f) const {
+		static thread_local vec_t scratch;
+		const double* x = position(i);
+		scratch.assign(x, x + dimension_);
+		return f(scratch.cbegin(), scratch.cend());
+	}
+
+	// [first, last) already is a contiguous matrix, values land in place
+	template <typename F>
+	void evaluate_batch(std::size_t first, std::size_t last, F f) {
+		f(position(first), last - first, dimension_, stride_, values_ + first);
+	}
+};
+
+#endif
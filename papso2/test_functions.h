@@ -8,6 +8,7 @@
 #include <vector>
 #include <tuple>
 #include <array>
+#include "test_functions_simd.h"
 #define PRINT
 #undef PRINT
 #ifdef PRINT
@@ -124,6 +125,13 @@ struct test_functions {
 		sphere, schwefel_12, rosenbrock, schwefel_26, rastrigin,
 		ackley, griewank
 	};
+	// Vectorized variants, same order as `functions`
+	static constexpr std::array<test_function_type, functions.size()> simd_functions = {
+		test_functions_simd::sphere, test_functions_simd::schwefel_12,
+		test_functions_simd::rosenbrock, test_functions_simd::schwefel_26,
+		test_functions_simd::rastrigin, test_functions_simd::ackley,
+		test_functions_simd::griewank
+	};
 	static constexpr unsigned dimensions[] = {
 		30u, 30u, 30u, 30u, 30u, 30u, 30u
 	};
@@ -0,0 +1,441 @@
+/*
+* Vectorized variants of test_functions
+* Squares are multiplies, every loop keeps several independent accumulators,
+* and sin/cos are replaced by branch-free approximations:
+*   cos_2pi(t), sin_2pi(t): t - round(t) and the quadrant split are exact, the
+*     Cephes minimax polynomials on [-pi/4, pi/4] are within 2 ulp, so the
+*     absolute error is below 1e-15.
+*   cos(x), sin(x) are evaluated as cos_2pi(x / 2pi), which adds one rounding
+*     of the scaled argument: absolute error below 1e-15 + |x| * 1.2e-16.
+* exp stays scalar, it is only applied to the final sums of ackley.
+* AVX2 is used when the CPU supports it, otherwise the same approximations run
+* in portable 4-lane loops.
+*/
+#ifndef _TEST_FUNCTIONS_SIMD
+#define _TEST_FUNCTIONS_SIMD
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include "cpu_features.h"
+
+struct test_functions_simd {
+	using iter = std::vector<double>::const_iterator;
+
+	static constexpr double Two_pi = 6.283185307179586476925;
+	static constexpr double Inv_two_pi = 0.159154943091895335769;
+
+	// Round to nearest for |t| < 2^51
+	static double round_nearest(double t) noexcept {
+		constexpr double magic = 6755399441055744.0; // 1.5 * 2^52
+		return (t + magic) - magic;
+	}
+	static double sin_poly(double a) noexcept { // |a| <= pi/4
+		const double z = a * a;
+		return a + a * z * (((((1.58962301576546568060E-10 * z
+			- 2.50507477628578072866E-8) * z
+			+ 2.75573136213857245213E-6) * z
+			- 1.98412698295895385996E-4) * z
+			+ 8.33333333332211858878E-3) * z
+			- 1.66666666666666307295E-1);
+	}
+	static double cos_poly(double a) noexcept { // |a| <= pi/4
+		const double z = a * a;
+		return 1. - 0.5 * z + z * z * (((((-1.13585365213876817300E-11 * z
+			+ 2.08757008419747316778E-9) * z
+			- 2.75573141792967388112E-7) * z
+			+ 2.48015872888517045348E-5) * z
+			- 1.38888888888730564116E-3) * z
+			+ 4.16666666666665929218E-2);
+	}
+	// cos(2 * pi * t)
+	static double cos_2pi(double t) noexcept {
+		t -= round_nearest(t);                 // [-1/2, 1/2]
+		const double q = round_nearest(4 * t); // quadrant in [-2, 2]
+		const double a = (t - 0.25 * q) * Two_pi;
+		const double r = (q == 1 || q == -1) ? sin_poly(a) : cos_poly(a);
+		return (q > 0.5 || q < -1.5) ? -r : r;
+	}
+	// sin(2 * pi * t)
+	static double sin_2pi(double t) noexcept {
+		t -= round_nearest(t);
+		const double q = round_nearest(4 * t);
+		const double a = (t - 0.25 * q) * Two_pi;
+		const double r = (q == 1 || q == -1) ? cos_poly(a) : sin_poly(a);
+		return (q < -0.5 || q > 1.5) ? -r : r;
+	}
+
+	// f1
+	static double sphere(iter beg, iter end) {
+		const double* x = std::to_address(beg);
+		const std::size_t n = end - beg;
+#if CPU_FEATURES_X86
+		if (use_avx2()) return sphere_avx2(x, n);
+#endif
+		return lane_sum(n, [x](std::size_t i) { return x[i] * x[i]; });
+	}
+
+	// f2, the prefix sums are a serial chain, only the squares are in lanes
+	static double schwefel_12(iter beg, iter end) {
+		const double* x = std::to_address(beg);
+		const std::size_t n = end - beg;
+#if CPU_FEATURES_X86
+		if (use_avx2()) return schwefel_12_avx2(x, n);
+#endif
+		return schwefel_12_tail(x, 0, n, 0., 0.);
+	}
+
+	// f3
+	static double rosenbrock(iter beg, iter end) {
+		const double* x = std::to_address(beg);
+		const std::size_t n = end - beg;
+		if (n < 2) return 0.;
+#if CPU_FEATURES_X86
+		if (use_avx2()) return rosenbrock_avx2(x, n);
+#endif
+		return lane_sum(n - 1, [x](std::size_t i) { return rosenbrock_term(x[i], x[i + 1]); });
+	}
+
+	// f4
+	static double schwefel_26(iter beg, iter end) {
+		const double* x = std::to_address(beg);
+		const std::size_t n = end - beg;
+#if CPU_FEATURES_X86
+		if (use_avx2()) return schwefel_26_avx2(x, n) / n;
+#endif
+		return lane_sum(n, [x](std::size_t i) { return schwefel_26_term(x[i]); }) / n;
+	}
+
+	// f5
+	static double rastrigin(iter beg, iter end) {
+		const double* x = std::to_address(beg);
+		const std::size_t n = end - beg;
+#if CPU_FEATURES_X86
+		if (use_avx2()) return rastrigin_avx2(x, n);
+#endif
+		return lane_sum(n, [x](std::size_t i) { return rastrigin_term(x[i]); });
+	}
+
+	// f6
+	static double ackley(iter beg, iter end) {
+		const double* x = std::to_address(beg);
+		const std::size_t n = end - beg;
+		double square_sum, cos_sum;
+#if CPU_FEATURES_X86
+		if (use_avx2()) {
+			ackley_avx2(x, n, square_sum, cos_sum);
+		}
+		else
+#endif
+		{
+			square_sum = lane_sum(n, [x](std::size_t i) { return x[i] * x[i]; });
+			cos_sum = lane_sum(n, [x](std::size_t i) { return cos_2pi(x[i]); });
+		}
+		const double dim = static_cast<double>(n);
+		return -20 * std::exp(-0.2 * std::sqrt(square_sum / dim))
+			- std::exp(cos_sum / dim)
+			+ 22.718282;
+	}
+
+	// f7
+	static double griewank(iter beg, iter end) {
+		const double* x = std::to_address(beg);
+		const std::size_t n = end - beg;
+		double sum, product;
+#if CPU_FEATURES_X86
+		if (use_avx2()) {
+			griewank_avx2(x, n, sum, product);
+		}
+		else
+#endif
+		{
+			sum = lane_sum(n, [x](std::size_t i) { return x[i] * x[i]; });
+			product = lane_product(n, [x](std::size_t i) { return griewank_factor(x[i], i); });
+		}
+		return sum / 4000. - product + 1.;
+	}
+
+private:
+	static double rosenbrock_term(double xi, double next) noexcept {
+		const double t = next - xi * xi;
+		return 100 * t * t + xi * xi;
+	}
+	static double schwefel_26_term(double xi) noexcept {
+		return xi * sin_2pi(std::sqrt(std::abs(xi)) * Inv_two_pi);
+	}
+	static double rastrigin_term(double xi) noexcept {
+		return xi * xi - 10 * cos_2pi(xi) + 10;
+	}
+	static double griewank_factor(double xi, std::size_t i) noexcept {
+		return cos_2pi(xi / std::sqrt(static_cast<double>(i + 1)) * Inv_two_pi);
+	}
+	static double schwefel_12_tail(const double* x, std::size_t i, std::size_t n, double partial_sum, double squares_sum) noexcept {
+		for (; i < n; ++i) {
+			partial_sum += x[i];
+			squares_sum += partial_sum * partial_sum;
+		}
+		return squares_sum;
+	}
+
+	// Portable fallback: 4 independent accumulators over term(i), i in [0, n)
+	template <typename F>
+	static double lane_sum(std::size_t n, F term) {
+		double acc[4] = { 0., 0., 0., 0. };
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			for (std::size_t l = 0; l < 4; ++l) {
+				acc[l] += term(i + l);
+			}
+		}
+		for (; i < n; ++i) {
+			acc[0] += term(i);
+		}
+		return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	}
+	template <typename F>
+	static double lane_product(std::size_t n, F factor) {
+		double acc[4] = { 1., 1., 1., 1. };
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			for (std::size_t l = 0; l < 4; ++l) {
+				acc[l] *= factor(i + l);
+			}
+		}
+		for (; i < n; ++i) {
+			acc[0] *= factor(i);
+		}
+		return (acc[0] * acc[1]) * (acc[2] * acc[3]);
+	}
+
+#if CPU_FEATURES_X86
+	static bool use_avx2() noexcept {
+		static const bool enabled = cpu_features::avx2();
+		return enabled;
+	}
+
+	CPU_FEATURES_TARGET("avx2")
+	static double hsum(__m256d v) noexcept {
+		__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+	CPU_FEATURES_TARGET("avx2")
+	static double hproduct(__m256d v) noexcept {
+		__m128d s = _mm_mul_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_mul_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+	CPU_FEATURES_TARGET("avx2")
+	static __m256d round_nearest(__m256d t) noexcept {
+		return _mm256_round_pd(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	}
+	CPU_FEATURES_TARGET("avx2")
+	static __m256d sin_poly(__m256d a) noexcept {
+		const __m256d z = _mm256_mul_pd(a, a);
+		__m256d p = _mm256_set1_pd(1.58962301576546568060E-10);
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(-2.50507477628578072866E-8));
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(2.75573136213857245213E-6));
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(-1.98412698295895385996E-4));
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(8.33333333332211858878E-3));
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(-1.66666666666666307295E-1));
+		return _mm256_add_pd(a, _mm256_mul_pd(_mm256_mul_pd(a, z), p));
+	}
+	CPU_FEATURES_TARGET("avx2")
+	static __m256d cos_poly(__m256d a) noexcept {
+		const __m256d z = _mm256_mul_pd(a, a);
+		__m256d p = _mm256_set1_pd(-1.13585365213876817300E-11);
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(2.08757008419747316778E-9));
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(-2.75573141792967388112E-7));
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(2.48015872888517045348E-5));
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(-1.38888888888730564116E-3));
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(4.16666666666665929218E-2));
+		const __m256d c = _mm256_sub_pd(_mm256_set1_pd(1.), _mm256_mul_pd(_mm256_set1_pd(0.5), z));
+		return _mm256_add_pd(c, _mm256_mul_pd(_mm256_mul_pd(z, z), p));
+	}
+	// Shared range reduction of sin_2pi/cos_2pi: returns the reduced angle
+	// and the quadrant in [-2, 2]
+	CPU_FEATURES_TARGET("avx2")
+	static __m256d reduce_2pi(__m256d t, __m256d& q) noexcept {
+		t = _mm256_sub_pd(t, round_nearest(t));
+		q = round_nearest(_mm256_mul_pd(_mm256_set1_pd(4.), t));
+		return _mm256_mul_pd(_mm256_sub_pd(t, _mm256_mul_pd(_mm256_set1_pd(0.25), q)), _mm256_set1_pd(Two_pi));
+	}
+	CPU_FEATURES_TARGET("avx2")
+	static __m256d cos_2pi(__m256d t) noexcept {
+		__m256d q;
+		const __m256d a = reduce_2pi(t, q);
+		const __m256d abs_q = _mm256_andnot_pd(_mm256_set1_pd(-0.), q);
+		const __m256d odd = _mm256_cmp_pd(abs_q, _mm256_set1_pd(1.), _CMP_EQ_OQ);
+		const __m256d neg = _mm256_or_pd(_mm256_cmp_pd(q, _mm256_set1_pd(0.5), _CMP_GT_OQ)
+			, _mm256_cmp_pd(q, _mm256_set1_pd(-1.5), _CMP_LT_OQ));
+		const __m256d r = _mm256_blendv_pd(cos_poly(a), sin_poly(a), odd);
+		return _mm256_xor_pd(r, _mm256_and_pd(neg, _mm256_set1_pd(-0.)));
+	}
+	CPU_FEATURES_TARGET("avx2")
+	static __m256d sin_2pi(__m256d t) noexcept {
+		__m256d q;
+		const __m256d a = reduce_2pi(t, q);
+		const __m256d abs_q = _mm256_andnot_pd(_mm256_set1_pd(-0.), q);
+		const __m256d odd = _mm256_cmp_pd(abs_q, _mm256_set1_pd(1.), _CMP_EQ_OQ);
+		const __m256d neg = _mm256_or_pd(_mm256_cmp_pd(q, _mm256_set1_pd(-0.5), _CMP_LT_OQ)
+			, _mm256_cmp_pd(q, _mm256_set1_pd(1.5), _CMP_GT_OQ));
+		const __m256d r = _mm256_blendv_pd(sin_poly(a), cos_poly(a), odd);
+		return _mm256_xor_pd(r, _mm256_and_pd(neg, _mm256_set1_pd(-0.)));
+	}
+
+	CPU_FEATURES_TARGET("avx2")
+	static double sphere_avx2(const double* x, std::size_t n) noexcept {
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		std::size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256d a = _mm256_loadu_pd(x + i);
+			const __m256d b = _mm256_loadu_pd(x + i + 4);
+			acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(a, a));
+			acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(b, b));
+		}
+		double sum = hsum(_mm256_add_pd(acc0, acc1));
+		for (; i < n; ++i) {
+			sum += x[i] * x[i];
+		}
+		return sum;
+	}
+
+	CPU_FEATURES_TARGET("avx2")
+	static double schwefel_12_avx2(const double* x, std::size_t n) noexcept {
+		const __m256d zero = _mm256_setzero_pd();
+		__m256d carry = zero;
+		__m256d acc = zero;
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			// In-register inclusive scan of 4 lanes
+			__m256d v = _mm256_loadu_pd(x + i);
+			v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0b0001));
+			v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0b0011));
+			v = _mm256_add_pd(v, carry);
+			acc = _mm256_add_pd(acc, _mm256_mul_pd(v, v));
+			carry = _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+		return schwefel_12_tail(x, i, n, _mm256_cvtsd_f64(carry), hsum(acc));
+	}
+
+	CPU_FEATURES_TARGET("avx2")
+	static double rosenbrock_avx2(const double* x, std::size_t n) noexcept {
+		const std::size_t m = n - 1; // terms
+		const __m256d hundred = _mm256_set1_pd(100.);
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		std::size_t i = 0;
+		for (; i + 8 <= m; i += 8) {
+			const __m256d a0 = _mm256_loadu_pd(x + i);
+			const __m256d a1 = _mm256_loadu_pd(x + i + 4);
+			const __m256d sq0 = _mm256_mul_pd(a0, a0);
+			const __m256d sq1 = _mm256_mul_pd(a1, a1);
+			const __m256d t0 = _mm256_sub_pd(_mm256_loadu_pd(x + i + 1), sq0);
+			const __m256d t1 = _mm256_sub_pd(_mm256_loadu_pd(x + i + 5), sq1);
+			acc0 = _mm256_add_pd(acc0, _mm256_add_pd(_mm256_mul_pd(hundred, _mm256_mul_pd(t0, t0)), sq0));
+			acc1 = _mm256_add_pd(acc1, _mm256_add_pd(_mm256_mul_pd(hundred, _mm256_mul_pd(t1, t1)), sq1));
+		}
+		double sum = hsum(_mm256_add_pd(acc0, acc1));
+		for (; i < m; ++i) {
+			sum += rosenbrock_term(x[i], x[i + 1]);
+		}
+		return sum;
+	}
+
+	CPU_FEATURES_TARGET("avx2")
+	static double schwefel_26_avx2(const double* x, std::size_t n) noexcept {
+		const __m256d sign = _mm256_set1_pd(-0.);
+		const __m256d inv_two_pi = _mm256_set1_pd(Inv_two_pi);
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		std::size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256d a = _mm256_loadu_pd(x + i);
+			const __m256d b = _mm256_loadu_pd(x + i + 4);
+			const __m256d sa = sin_2pi(_mm256_mul_pd(_mm256_sqrt_pd(_mm256_andnot_pd(sign, a)), inv_two_pi));
+			const __m256d sb = sin_2pi(_mm256_mul_pd(_mm256_sqrt_pd(_mm256_andnot_pd(sign, b)), inv_two_pi));
+			acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(a, sa));
+			acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(b, sb));
+		}
+		double sum = hsum(_mm256_add_pd(acc0, acc1));
+		for (; i < n; ++i) {
+			sum += schwefel_26_term(x[i]);
+		}
+		return sum;
+	}
+
+	CPU_FEATURES_TARGET("avx2")
+	static double rastrigin_avx2(const double* x, std::size_t n) noexcept {
+		const __m256d ten = _mm256_set1_pd(10.);
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		std::size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256d a = _mm256_loadu_pd(x + i);
+			const __m256d b = _mm256_loadu_pd(x + i + 4);
+			const __m256d ta = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(ten, cos_2pi(a))), ten);
+			const __m256d tb = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(ten, cos_2pi(b))), ten);
+			acc0 = _mm256_add_pd(acc0, ta);
+			acc1 = _mm256_add_pd(acc1, tb);
+		}
+		double sum = hsum(_mm256_add_pd(acc0, acc1));
+		for (; i < n; ++i) {
+			sum += rastrigin_term(x[i]);
+		}
+		return sum;
+	}
+
+	CPU_FEATURES_TARGET("avx2")
+	static void ackley_avx2(const double* x, std::size_t n, double& square_sum, double& cos_sum) noexcept {
+		__m256d sq0 = _mm256_setzero_pd();
+		__m256d sq1 = _mm256_setzero_pd();
+		__m256d cs0 = _mm256_setzero_pd();
+		__m256d cs1 = _mm256_setzero_pd();
+		std::size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256d a = _mm256_loadu_pd(x + i);
+			const __m256d b = _mm256_loadu_pd(x + i + 4);
+			sq0 = _mm256_add_pd(sq0, _mm256_mul_pd(a, a));
+			sq1 = _mm256_add_pd(sq1, _mm256_mul_pd(b, b));
+			cs0 = _mm256_add_pd(cs0, cos_2pi(a));
+			cs1 = _mm256_add_pd(cs1, cos_2pi(b));
+		}
+		square_sum = hsum(_mm256_add_pd(sq0, sq1));
+		cos_sum = hsum(_mm256_add_pd(cs0, cs1));
+		for (; i < n; ++i) {
+			square_sum += x[i] * x[i];
+			cos_sum += cos_2pi(x[i]);
+		}
+	}
+
+	CPU_FEATURES_TARGET("avx2")
+	static void griewank_avx2(const double* x, std::size_t n, double& sum, double& product) noexcept {
+		const __m256d inv_two_pi = _mm256_set1_pd(Inv_two_pi);
+		const __m256d eight = _mm256_set1_pd(8.);
+		__m256d idx0 = _mm256_setr_pd(1., 2., 3., 4.); // i + 1
+		__m256d idx1 = _mm256_setr_pd(5., 6., 7., 8.);
+		__m256d sq0 = _mm256_setzero_pd();
+		__m256d sq1 = _mm256_setzero_pd();
+		__m256d pr0 = _mm256_set1_pd(1.);
+		__m256d pr1 = _mm256_set1_pd(1.);
+		std::size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256d a = _mm256_loadu_pd(x + i);
+			const __m256d b = _mm256_loadu_pd(x + i + 4);
+			sq0 = _mm256_add_pd(sq0, _mm256_mul_pd(a, a));
+			sq1 = _mm256_add_pd(sq1, _mm256_mul_pd(b, b));
+			pr0 = _mm256_mul_pd(pr0, cos_2pi(_mm256_mul_pd(_mm256_div_pd(a, _mm256_sqrt_pd(idx0)), inv_two_pi)));
+			pr1 = _mm256_mul_pd(pr1, cos_2pi(_mm256_mul_pd(_mm256_div_pd(b, _mm256_sqrt_pd(idx1)), inv_two_pi)));
+			idx0 = _mm256_add_pd(idx0, eight);
+			idx1 = _mm256_add_pd(idx1, eight);
+		}
+		sum = hsum(_mm256_add_pd(sq0, sq1));
+		product = hproduct(_mm256_mul_pd(pr0, pr1));
+		for (; i < n; ++i) {
+			sum += x[i] * x[i];
+			product *= griewank_factor(x[i], i);
+		}
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+* Processor topology and thread pinning for hb_executor
+* Linux reads sysfs and restricts itself to the CPUs of the process affinity
+* mask; elsewhere every logical processor is its own core on package 0.
+*/
+#ifndef _TOPOLOGY
+#define _TOPOLOGY
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <tuple>
+#include <thread>
+#include <cstddef>
+#ifdef _MSC_VER
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace hungbiu
+{
+	struct logical_cpu {
+		unsigned id;
+		unsigned core;    // Core id, unique within a package
+		unsigned package; // Socket
+		unsigned node;    // NUMA node
+	};
+
+	// Where worker i runs
+	enum class thread_placement {
+		none,    // Let the OS schedule
+		compact, // Fill SMT siblings, then cores, then the next package
+		scatter, // One worker per package in turn, SMT siblings last
+		list     // cpus[i % cpus.size()]
+	};
+
+	// Opt-in: workers are not pinned unless a policy is given
+	struct placement_t {
+		thread_placement policy = thread_placement::none;
+		std::vector<unsigned> cpus; // For `list`
+	};
+
+	class cpu_topology {
+		std::vector<logical_cpu> cpus_; // Those this process may run on
+
+#if defined(__linux__)
+		static bool read_number(const std::string& path, unsigned& out) {
+			std::ifstream in{ path };
+			return static_cast<bool>(in >> out);
+		}
+
+		cpu_topology() {
+			cpu_set_t allowed;
+			CPU_ZERO(&allowed);
+			if (0 != sched_getaffinity(0, sizeof(allowed), &allowed)) {
+				return;
+			}
+
+			namespace fs = std::filesystem;
+			for (unsigned id = 0; id < CPU_SETSIZE; ++id) {
+				if (!CPU_ISSET(id, &allowed)) {
+					continue;
+				}
+				const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+				logical_cpu cpu{ id, id, 0, 0 };
+				read_number(dir + "/topology/core_id", cpu.core);
+				read_number(dir + "/topology/physical_package_id", cpu.package);
+
+				// The node shows up as a `nodeN` link in the cpu directory
+				std::error_code ec;
+				for (const auto& entry : fs::directory_iterator(dir, ec)) {
+					const std::string name = entry.path().filename().string();
+					if (name.size() > 4 && 0 == name.compare(0, 4, "node")) {
+						cpu.node = static_cast<unsigned>(std::stoul(name.substr(4)));
+						break;
+					}
+				}
+				cpus_.push_back(cpu);
+			}
+		}
+#else
+		cpu_topology() {
+			unsigned count = std::max(1u, std::thread::hardware_concurrency());
+#ifdef _MSC_VER
+			count = std::min<unsigned>(count, sizeof(DWORD_PTR) * 8); // One processor group
+#endif
+			for (unsigned id = 0; id < count; ++id) {
+				logical_cpu cpu{ id, id, 0, 0 };
+#ifdef _MSC_VER
+				UCHAR node = 0;
+				if (GetNumaProcessorNode(static_cast<UCHAR>(id), &node)) {
+					cpu.node = node;
+				}
+#endif
+				cpus_.push_back(cpu);
+			}
+		}
+#endif
+
+	public:
+		// Discovered once
+		static const cpu_topology& get() {
+			static const cpu_topology topology;
+			return topology;
+		}
+
+		const std::vector<logical_cpu>& cpus() const noexcept { return cpus_; }
+
+		const logical_cpu* find(unsigned id) const noexcept {
+			auto it = std::find_if(cpus_.begin(), cpus_.end(), [id](const logical_cpu& c) { return c.id == id; });
+			return it == cpus_.end() ? nullptr : &*it;
+		}
+
+		std::vector<unsigned> compact() const {
+			auto sorted = cpus_;
+			std::sort(sorted.begin(), sorted.end(), [](const logical_cpu& a, const logical_cpu& b) {
+				return std::tie(a.node, a.package, a.core, a.id) < std::tie(b.node, b.package, b.core, b.id);
+			});
+			return ids(sorted);
+		}
+
+		std::vector<unsigned> scatter() const {
+			// Rank every cpu by its SMT slot and by its core within the package
+			struct ranked {
+				unsigned smt, core, package, id;
+			};
+			auto sorted = cpus_;
+			std::sort(sorted.begin(), sorted.end(), [](const logical_cpu& a, const logical_cpu& b) {
+				return std::tie(a.package, a.core, a.id) < std::tie(b.package, b.core, b.id);
+			});
+			std::vector<ranked> order;
+			order.reserve(sorted.size());
+			unsigned core_rank = 0, smt = 0;
+			for (std::size_t i = 0; i < sorted.size(); ++i) {
+				const auto& c = sorted[i];
+				if (i > 0) {
+					const auto& p = sorted[i - 1];
+					if (p.package != c.package) {
+						core_rank = 0;
+						smt = 0;
+					}
+					else if (p.core != c.core) {
+						++core_rank;
+						smt = 0;
+					}
+					else {
+						++smt;
+					}
+				}
+				order.push_back({ smt, core_rank, c.package, c.id });
+			}
+			std::sort(order.begin(), order.end(), [](const ranked& a, const ranked& b) {
+				return std::tie(a.smt, a.core, a.package, a.id) < std::tie(b.smt, b.core, b.package, b.id);
+			});
+
+			std::vector<unsigned> result;
+			result.reserve(order.size());
+			for (const auto& r : order) {
+				result.push_back(r.id);
+			}
+			return result;
+		}
+
+		// CPU of worker `index` for `placement`, -1 if unpinned
+		int cpu_for(const placement_t& placement, std::size_t index) const {
+			std::vector<unsigned> order;
+			switch (placement.policy) {
+			case thread_placement::compact: order = compact(); break;
+			case thread_placement::scatter: order = scatter(); break;
+			case thread_placement::list:    order = placement.cpus; break;
+			default: break;
+			}
+			if (order.empty()) {
+				return -1;
+			}
+			return static_cast<int>(order[index % order.size()]);
+		}
+
+		// Best effort, returns false if the OS refused
+		static bool pin_current_thread(unsigned cpu) noexcept {
+#ifdef _MSC_VER
+			if (cpu >= sizeof(DWORD_PTR) * 8) {
+				return false;
+			}
+			return 0 != SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{ 1 } << cpu);
+#elif defined(__linux__)
+			if (cpu >= CPU_SETSIZE) {
+				return false;
+			}
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpu, &set);
+			return 0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+			return false;
+#endif
+		}
+
+	private:
+		static std::vector<unsigned> ids(const std::vector<logical_cpu>& cpus) {
+			std::vector<unsigned> result;
+			result.reserve(cpus.size());
+			for (const auto& c : cpus) {
+				result.push_back(c.id);
+			}
+			return result;
+		}
+	};
+} // end namespace hungbiu
+
+#endif
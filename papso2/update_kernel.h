@@ -0,0 +1,140 @@
+/*
+* Velocity and position update of one particle
+* Scalar, AVX2 and AVX-512 variants share the same operation order, so they
+* produce identical results; the widest one supported by the CPU is picked
+* once at runtime.
+*/
+#ifndef _UPDATE_KERNEL
+#define _UPDATE_KERNEL
+#include <cstddef>
+#include "cpu_features.h"
+
+struct update_kernel {
+	static constexpr double INERTIA = 0.7298;
+	static constexpr double ACCELERATOR = 1.49618;
+
+	// r1, r2: `dim` uniform numbers in [0, 1) for the cognitive and social terms
+	using kernel_type = void(*)(double* velocity, double* position
+		, const double* pbest, const double* lbest
+		, const double* r1, const double* r2
+		, std::size_t dim, double min, double max);
+
+	static void scalar(double* velocity, double* position
+		, const double* pbest, const double* lbest
+		, const double* r1, const double* r2
+		, std::size_t dim, double min, double max) {
+		scalar_tail(velocity, position, pbest, lbest, r1, r2, 0, dim, min, max);
+	}
+
+#if CPU_FEATURES_X86
+	CPU_FEATURES_TARGET("avx2")
+	static void avx2(double* velocity, double* position
+		, const double* pbest, const double* lbest
+		, const double* r1, const double* r2
+		, std::size_t dim, double min, double max) {
+		const __m256d w = _mm256_set1_pd(INERTIA);
+		const __m256d c = _mm256_set1_pd(ACCELERATOR);
+		const __m256d lo = _mm256_set1_pd(min);
+		const __m256d hi = _mm256_set1_pd(max);
+
+		std::size_t d = 0;
+		for (; d + 4 <= dim; d += 4) {
+			__m256d v = _mm256_loadu_pd(velocity + d);
+			__m256d x = _mm256_loadu_pd(position + d);
+			__m256d cognitive = _mm256_mul_pd(_mm256_mul_pd(c, _mm256_loadu_pd(r1 + d))
+				, _mm256_sub_pd(_mm256_loadu_pd(pbest + d), x));
+			__m256d social = _mm256_mul_pd(_mm256_mul_pd(c, _mm256_loadu_pd(r2 + d))
+				, _mm256_sub_pd(_mm256_loadu_pd(lbest + d), x));
+			v = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(w, v), cognitive), social);
+			x = _mm256_add_pd(x, v);
+
+			// Confinement: clamp x, zero v where it left the box. min/max return
+			// their second operand on NaN, so a NaN x passes through as in scalar
+			__m256d out = _mm256_or_pd(_mm256_cmp_pd(x, lo, _CMP_LT_OQ), _mm256_cmp_pd(x, hi, _CMP_GT_OQ));
+			x = _mm256_min_pd(hi, _mm256_max_pd(lo, x));
+			v = _mm256_andnot_pd(out, v);
+
+			_mm256_storeu_pd(velocity + d, v);
+			_mm256_storeu_pd(position + d, x);
+		}
+		scalar_tail(velocity, position, pbest, lbest, r1, r2, d, dim, min, max);
+	}
+
+	CPU_FEATURES_TARGET("avx512f")
+	static void avx512(double* velocity, double* position
+		, const double* pbest, const double* lbest
+		, const double* r1, const double* r2
+		, std::size_t dim, double min, double max) {
+		const __m512d w = _mm512_set1_pd(INERTIA);
+		const __m512d c = _mm512_set1_pd(ACCELERATOR);
+		const __m512d lo = _mm512_set1_pd(min);
+		const __m512d hi = _mm512_set1_pd(max);
+
+		for (std::size_t d = 0; d < dim; d += 8) {
+			// Masked loads/stores cover the tail
+			const std::size_t left = dim - d;
+			const __mmask8 m = left >= 8 ? __mmask8(0xFF) : __mmask8((1u << left) - 1);
+
+			__m512d v = _mm512_maskz_loadu_pd(m, velocity + d);
+			__m512d x = _mm512_maskz_loadu_pd(m, position + d);
+			__m512d cognitive = _mm512_mul_pd(_mm512_mul_pd(c, _mm512_maskz_loadu_pd(m, r1 + d))
+				, _mm512_sub_pd(_mm512_maskz_loadu_pd(m, pbest + d), x));
+			__m512d social = _mm512_mul_pd(_mm512_mul_pd(c, _mm512_maskz_loadu_pd(m, r2 + d))
+				, _mm512_sub_pd(_mm512_maskz_loadu_pd(m, lbest + d), x));
+			v = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(w, v), cognitive), social);
+			x = _mm512_add_pd(x, v);
+
+			// Confinement: clamp x, zero v where it left the box, NaN passes through.
+			// The masked forms merge into x rather than an undefined register,
+			// which GCC reports as maybe uninitialized
+			__mmask8 out = _mm512_cmp_pd_mask(x, lo, _CMP_LT_OQ) | _mm512_cmp_pd_mask(x, hi, _CMP_GT_OQ);
+			x = _mm512_mask_min_pd(x, m, hi, _mm512_mask_max_pd(x, m, lo, x));
+			v = _mm512_mask_blend_pd(out, v, _mm512_setzero_pd());
+
+			_mm512_mask_storeu_pd(velocity + d, m, v);
+			_mm512_mask_storeu_pd(position + d, m, x);
+		}
+	}
+#endif
+
+	// Widest kernel supported by this CPU, resolved once
+	static kernel_type get() noexcept {
+		static const kernel_type kernel = select();
+		return kernel;
+	}
+
+private:
+	static void scalar_tail(double* velocity, double* position
+		, const double* pbest, const double* lbest
+		, const double* r1, const double* r2
+		, std::size_t first, std::size_t dim, double min, double max) {
+		for (std::size_t d = first; d < dim; ++d) {
+			double& vi = velocity[d];
+			double& xi = position[d];
+			vi = INERTIA * vi
+				+ ACCELERATOR * r1[d] * (pbest[d] - xi)
+				+ ACCELERATOR * r2[d] * (lbest[d] - xi);
+			xi += vi;
+
+			// Confinement, a NaN xi is left as is
+			if (xi < min) {
+				xi = min;
+				vi = 0;
+			}
+			else if (xi > max) {
+				xi = max;
+				vi = 0;
+			}
+		}
+	}
+
+	static kernel_type select() noexcept {
+#if CPU_FEATURES_X86
+		if (cpu_features::avx512f()) return &avx512;
+		if (cpu_features::avx2()) return &avx2;
+#endif
+		return &scalar;
+	}
+};
+
+#endif